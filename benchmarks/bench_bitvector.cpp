@@ -1,7 +1,7 @@
 ﻿#include <benchmark/benchmark.h>
 #include <random>
 #include <vector>
-#include "bitvector.hpp"
+#include "slot_states.hpp"
 
 using namespace boomphf;
 
@@ -57,20 +57,60 @@ static void BM_BuildRanks(benchmark::State& state)
 }
 BENCHMARK(BM_BuildRanks)->Arg(1<<10)->Arg(1<<16)->Arg(1<<20)->Unit(benchmark::kMillisecond);
 
+// Level finalization: slot states converted to the level bit array and its ranks built.
+// Args: threads, 0 for a separate build_ranks pass or 1 for ranks built during the conversion
+static void BM_FinalizeLevel(benchmark::State& state)
+{
+    const uint64_t nbits = 1ULL << 24;
+    const auto nthreads = static_cast<uint32_t>(state.range(0));
+    const bool fused = state.range(1) != 0;
+    std::mt19937_64 rng(5);
+    std::vector<uint64_t> positions(nbits / 2);
+    for (auto& pos : positions)
+        pos = rng() % nbits;
+
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        slot_states slots(nbits);
+        for (const uint64_t pos : positions)
+            slots.insert(pos);
+        state.ResumeTiming();
+        uint64_t offset = 0;
+        if (fused)
+        {
+            benchmark::DoNotOptimize(
+                std::move(slots).to_bitvector(offset, bitVector::DEFAULT_RANK_BLOCK_BITS, nthreads));
+        }
+        else
+        {
+            bitVector level = std::move(slots).to_bitvector(nthreads);
+            benchmark::DoNotOptimize(level.build_ranks(0, bitVector::DEFAULT_RANK_BLOCK_BITS, nthreads));
+        }
+    }
+}
+BENCHMARK(BM_FinalizeLevel)
+    ->Args({1, 0})->Args({1, 1})->Args({4, 0})->Args({4, 1})
+    ->Unit(benchmark::kMillisecond);
+
+// Args: bit count, rank block size in bits
 static void BM_RankQueries(benchmark::State& state)
 {
     const uint64_t nbits = static_cast<uint64_t>(state.range(0));
     bitVector bv(nbits);
     for (uint64_t i = 0; i < nbits; i += 3)
         bv.set(i);
-    [[maybe_unused]] auto ignored = bv.build_ranks(0);
+    [[maybe_unused]] auto ignored = bv.build_ranks(0, static_cast<uint64_t>(state.range(1)));
 
     for (auto _ : state)
     {
         for (uint64_t i = 0; i < nbits; i += 13)
             benchmark::DoNotOptimize(bv.rank(i));
     }
+    state.counters["rank_overhead_%"] = 100.0 * static_cast<double>(bv.bitSize() - nbits) / static_cast<double>(nbits);
 }
-BENCHMARK(BM_RankQueries)->Arg(1<<10)->Arg(1<<16)->Arg(1<<20)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_RankQueries)
+    ->ArgsProduct({{1<<10, 1<<16, 1<<20}, {64, 128, 512}})
+    ->Unit(benchmark::kMillisecond);
 
 BENCHMARK_MAIN();
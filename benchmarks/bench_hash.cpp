@@ -0,0 +1,186 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <string_view>
+#include <vector>
+#include "BooPHF.h"
+
+using namespace boomphf;
+
+namespace
+{
+
+std::vector<uint64_t> make_keys(size_t n, bool sequential)
+{
+    std::vector<uint64_t> keys(n);
+    std::mt19937_64 rng(42);
+    for (size_t i = 0; i < n; ++i)
+        keys[i] = sequential ? i : rng();
+    return keys;
+}
+
+// Fraction of keys that share their level-0 slot with another key (gamma = 2)
+template <typename Hasher> double level0_collision_rate(const std::vector<uint64_t>& keys)
+{
+    const uint64_t domain = 2 * keys.size();
+    std::vector<uint8_t> counts(domain, 0);
+    Hasher hasher;
+    for (auto k : keys)
+    {
+        uint8_t& c = counts[fastrange64(hasher(k, 0xAAAAAAAA55555555ULL), domain)];
+        if (c < 2)
+            ++c;
+    }
+
+    uint64_t singles = 0;
+    for (auto c : counts)
+        singles += (c == 1);
+    return 1.0 - static_cast<double>(singles) / static_cast<double>(keys.size());
+}
+
+} // namespace
+
+// Hash throughput: one seeded hash per key, as done by XorshiftHashFunctors::h0/h1
+template <typename Hasher> static void BM_Hash(benchmark::State& state)
+{
+    const auto keys = make_keys(1 << 16, state.range(0) != 0);
+    Hasher hasher;
+
+    for (auto _ : state)
+    {
+        uint64_t acc = 0;
+        for (auto k : keys)
+            acc += hasher(k, 0xAAAAAAAA55555555ULL);
+        benchmark::DoNotOptimize(acc);
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * keys.size()));
+    state.counters["collision_rate"] = level0_collision_rate<Hasher>(make_keys(1 << 20, state.range(0) != 0));
+}
+
+// Arg(0): random keys, Arg(1): sequential keys
+BENCHMARK_TEMPLATE(BM_Hash, SingleHashFunctor<uint64_t>)->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(BM_Hash, Murmur3Hasher<uint64_t>)->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(BM_Hash, WyHasher<uint64_t>)->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(BM_Hash, Crc32cHasher<uint64_t>)->Arg(0)->Arg(1);
+
+// End-to-end lookups through the full level cascade
+template <typename Hasher> static void BM_Lookup(benchmark::State& state)
+{
+    const auto keys = make_keys(1 << 20, false);
+    mphf<uint64_t, Hasher> bphf(keys.size(), keys, 1, 2.0, false, false);
+
+    for (auto _ : state)
+    {
+        uint64_t acc = 0;
+        for (size_t i = 0; i < keys.size(); i += 7)
+            acc += bphf.lookup(keys[i]);
+        benchmark::DoNotOptimize(acc);
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * (keys.size() + 6) / 7));
+}
+
+BENCHMARK_TEMPLATE(BM_Lookup, SingleHashFunctor<uint64_t>)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Lookup, Murmur3Hasher<uint64_t>)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Lookup, WyHasher<uint64_t>)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Lookup, Crc32cHasher<uint64_t>)->Unit(benchmark::kMillisecond);
+
+// Arg(1): minimal (rank per lookup), Arg(0): non-minimal (raw level position, no rank arrays)
+static void BM_LookupMinimal(benchmark::State& state)
+{
+    const auto keys = make_keys(1 << 20, false);
+    mphf_options options;
+    options.minimal = state.range(0) != 0;
+    mphf<uint64_t, WyHasher<uint64_t>> bphf(keys.size(), keys, 1, 2.0, false, false, 0.03f, options);
+
+    for (auto _ : state)
+    {
+        uint64_t acc = 0;
+        for (size_t i = 0; i < keys.size(); i += 7)
+            acc += bphf.lookup(keys[i]);
+        benchmark::DoNotOptimize(acc);
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * (keys.size() + 6) / 7));
+    state.counters["range/n"] = static_cast<double>(bphf.hashRange()) / static_cast<double>(keys.size());
+}
+
+BENCHMARK(BM_LookupMinimal)->Arg(1)->Arg(0)->Unit(benchmark::kMillisecond);
+
+// Arg(0): levels 0 and 1 in separate arrays, Arg(1): blocked layout (level 1 in the line of level 0)
+// 8M keys so that the levels do not fit in cache
+static void BM_LookupBlocked(benchmark::State& state)
+{
+    const auto keys = make_keys(1 << 23, false);
+    mphf_options options;
+    options.blocked_levels = state.range(0) != 0;
+    mphf<uint64_t, WyHasher<uint64_t>> bphf(keys.size(), keys, 1, 2.0, false, false, 0.03f, options);
+
+    for (auto _ : state)
+    {
+        uint64_t acc = 0;
+        for (size_t i = 0; i < keys.size(); i += 7)
+            acc += bphf.lookup(keys[i]);
+        benchmark::DoNotOptimize(acc);
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * (keys.size() + 6) / 7));
+}
+
+BENCHMARK(BM_LookupBlocked)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+// Args({gamma, reduction}): reduction 0 maps hashes to level positions by modulo, 1 by multiply-shift
+static void BM_LookupReduction(benchmark::State& state)
+{
+    const auto keys = make_keys(1 << 20, false);
+    const auto gamma = static_cast<double>(state.range(0));
+    mphf_options options;
+    options.reduction = state.range(1) != 0 ? range_reduction::multiply_shift : range_reduction::modulo;
+    mphf<uint64_t, WyHasher<uint64_t>> bphf(keys.size(), keys, 1, gamma, false, false, 0.03f, options);
+
+    for (auto _ : state)
+    {
+        uint64_t acc = 0;
+        for (size_t i = 0; i < keys.size(); i += 7)
+            acc += bphf.lookup(keys[i]);
+        benchmark::DoNotOptimize(acc);
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * (keys.size() + 6) / 7));
+}
+
+BENCHMARK(BM_LookupReduction)->ArgsProduct({{1, 2, 5}, {0, 1}})->Unit(benchmark::kMillisecond);
+
+// Digest keys: bytes used as-is vs. re-hashed as a byte string
+struct RehashDigestHasher
+{
+    boomphf::hash_pair_t operator()(const digest_t<20>& key, uint64_t seed) const
+    {
+        return StringHasher()(std::string_view(reinterpret_cast<const char*>(key.data()), key.size()), seed);
+    }
+};
+
+template <typename Hasher> static void BM_DigestLookup(benchmark::State& state)
+{
+    std::vector<digest_t<20>> keys(1 << 20);
+    std::mt19937_64 rng(42);
+    for (auto& k : keys)
+        for (auto& b : k)
+            b = static_cast<uint8_t>(rng());
+    mphf<digest_t<20>, Hasher> bphf(keys.size(), keys, 1, 2.0, false, false);
+
+    for (auto _ : state)
+    {
+        uint64_t acc = 0;
+        for (size_t i = 0; i < keys.size(); i += 7)
+            acc += bphf.lookup(keys[i]);
+        benchmark::DoNotOptimize(acc);
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * (keys.size() + 6) / 7));
+}
+
+BENCHMARK_TEMPLATE(BM_DigestLookup, DigestHasher<digest_t<20>>)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_DigestLookup, RehashDigestHasher)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,44 @@
+#include "relabel.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+// Turns a binary file of uint64_t keys (e.g. the endpoints of an edge list) into their dense ids.
+// The MPHF must have been saved from a boomphf::mphf<uint64_t, boomphf::SingleHashFunctor<uint64_t>>.
+
+typedef boomphf::mphf<uint64_t, boomphf::SingleHashFunctor<uint64_t>> boophf_t;
+
+int main(int argc, char* argv[])
+{
+	if (argc < 4 || argc > 5)
+	{
+		std::cerr << "Usage :\n" << argv[0] << " <mphf file> <input keys file> <output ids file> [nthreads]\n";
+		return EXIT_FAILURE;
+	}
+	const unsigned nthreads = argc == 5 ? static_cast<unsigned>(std::atoi(argv[4])) : 1;
+
+	std::ifstream is(argv[1], std::ios::binary);
+	if (!is)
+	{
+		std::cerr << "Cannot open " << argv[1] << "\n";
+		return EXIT_FAILURE;
+	}
+	try
+	{
+		boophf_t bphf;
+		bphf.load(is);
+
+		const auto start = std::chrono::steady_clock::now();
+		const uint64_t n = boomphf::relabel(bphf, argv[2], argv[3], nthreads);
+		const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "Relabeled " << n << " keys in " << elapsed << " s (" << (n / elapsed / 1e6) << " M keys/s)\n";
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
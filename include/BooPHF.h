@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cinttypes>
@@ -18,174 +19,40 @@
 #include <iterator>
 #include <memory>
 #include <mutex>
+#include <stdexcept>
+#include <string>
 #include <thread>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
 #include "bitvector.hpp"
+#include "elias_fano.hpp"
 #include "endian_utils.hpp"
+#include "hashers.hpp"
+#include "key_file.hpp"
+#include "key_traits.hpp"
+#include "mapped_file.hpp"
+#include "packed_array.hpp"
 #include "platform_time.h"
 #include "progress.hpp"
+#include "slot_states.hpp"
 
 namespace boomphf
 {
 
-/// Buffered file iterator for reading binary data
-template <typename basetype> class bfile_iterator
-{
-public:
-	using iterator_category = std::forward_iterator_tag;
-	using value_type = basetype;
-	using difference_type = std::ptrdiff_t;
-	using pointer = const basetype*;
-	using reference = const basetype&;
-
-	bfile_iterator() : _is(nullptr), _pos(0), _inbuff(0), _cptread(0), _buffsize(10000)
-	{
-		_buffer = static_cast<basetype*>(std::malloc(_buffsize * sizeof(basetype)));
-	}
-
-	bfile_iterator(const bfile_iterator& cr)
-	    : _is(cr._is), _pos(cr._pos), _buffsize(cr._buffsize), _inbuff(cr._inbuff), _cptread(cr._cptread),
-	      _elem(cr._elem)
-	{
-		_buffer = static_cast<basetype*>(std::malloc(_buffsize * sizeof(basetype)));
-		std::memcpy(_buffer, cr._buffer, _buffsize * sizeof(basetype));
-	}
-
-	bfile_iterator& operator=(const bfile_iterator& cr)
-	{
-		if (this != &cr)
-		{
-			_is = cr._is;
-			_pos = cr._pos;
-			_buffsize = cr._buffsize;
-			_inbuff = cr._inbuff;
-			_cptread = cr._cptread;
-			_elem = cr._elem;
-			std::free(_buffer);
-			_buffer = static_cast<basetype*>(std::malloc(_buffsize * sizeof(basetype)));
-			std::memcpy(_buffer, cr._buffer, _buffsize * sizeof(basetype));
-		}
-		return *this;
-	}
-
-	explicit bfile_iterator(FILE* is) : _is(is), _pos(0), _inbuff(0), _cptread(0), _buffsize(10000)
-	{
-		_buffer = static_cast<basetype*>(std::malloc(_buffsize * sizeof(basetype)));
-		std::fseek(_is, 0, SEEK_SET);
-		advance();
-	}
-
-	~bfile_iterator() { std::free(_buffer); }
-
-	reference operator*() const { return _elem; }
-
-	bfile_iterator& operator++()
-	{
-		advance();
-		return *this;
-	}
-
-	friend bool operator==(const bfile_iterator& lhs, const bfile_iterator& rhs)
-	{
-		if (!lhs._is || !rhs._is)
-		{
-			return !lhs._is && !rhs._is;
-		}
-		assert(lhs._is == rhs._is);
-		return rhs._pos == lhs._pos;
-	}
-
-	friend bool operator!=(const bfile_iterator& lhs, const bfile_iterator& rhs) { return !(lhs == rhs); }
-
-private:
-	void advance()
-	{
-		++_pos;
-
-		if (_cptread >= _inbuff)
-		{
-			const size_t res = std::fread(_buffer, sizeof(basetype), _buffsize, _is);
-			_inbuff = res;
-			_cptread = 0;
-
-			if (res == 0)
-			{
-				_is = nullptr;
-				_pos = 0;
-				return;
-			}
-		}
-
-		_elem = _buffer[_cptread];
-		++_cptread;
-	}
-
-	basetype _elem;
-	FILE* _is;
-	uint64_t _pos;
-	basetype* _buffer;
-	size_t _inbuff;
-	size_t _cptread;
-	size_t _buffsize;
-};
-
-/// Binary file reader with iterator interface
-template <typename type_elem> class file_binary
-{
-public:
-	file_binary(const file_binary&) = delete;
-	file_binary& operator=(const file_binary&) = delete;
-
-	file_binary(file_binary&& other) noexcept : _is(other._is) { other._is = nullptr; }
-	file_binary& operator=(file_binary&& other) noexcept
-	{
-		if (this != &other)
-		{
-			if (_is) std::fclose(_is);
-			_is = other._is;
-			other._is = nullptr;
-		}
-		return *this;
-	}
-
-	explicit file_binary(const char* filename)
-	{
-		_is = std::fopen(filename, "rb");
-		if (!_is)
-		{
-			throw std::invalid_argument("Error opening " + std::string(filename));
-		}
-	}
-
-	explicit file_binary(const std::string& filename) : file_binary(filename.c_str()) {}
-
-	~file_binary() { if (_is) std::fclose(_is); }
-
-	[[nodiscard]] bfile_iterator<type_elem> begin() const { return bfile_iterator<type_elem>(_is); }
-
-	[[nodiscard]] bfile_iterator<type_elem> end() const { return bfile_iterator<type_elem>(); }
-
-	[[nodiscard]] size_t size() const { return 0; }
-
-private:
-	FILE* _is;
-};
-
 ////////////////////////////////////////////////////////////////
 // Hash functions
 ////////////////////////////////////////////////////////////////
 
-using hash_set_t = std::array<uint64_t, 10>;
-using hash_pair_t = std::array<uint64_t, 2>;
-
 /// Hash function generator for Items
 template <typename Item> class HashFunctors
 {
 public:
 	HashFunctors() : _nbFct(7), _user_seed(0) { generate_hash_seed(); }
 
+	explicit HashFunctors(uint64_t user_seed) : _nbFct(7), _user_seed(user_seed) { generate_hash_seed(); }
+
 	[[nodiscard]] uint64_t operator()(const Item& key, size_t idx) const { return hash64(key, _seed_tab[idx]); }
 
 	[[nodiscard]] uint64_t hashWithSeed(const Item& key, uint64_t seed) const { return hash64(key, seed); }
@@ -240,6 +107,7 @@ private:
 };
 
 /// Wrapper to return single hash value instead of multiple hashes
+/// Faster drop-in alternatives for integer keys live in hashers.hpp (Murmur3Hasher, WyHasher, Crc32cHasher)
 template <typename Item> class SingleHashFunctor
 {
 public:
@@ -252,12 +120,40 @@ private:
 	HashFunctors<Item> hashFunctors;
 };
 
+/// Result type of a hasher called as hasher(key, seed)
+template <typename Item, class Hasher_t>
+using hasher_result_t = std::decay_t<std::invoke_result_t<const Hasher_t&, const Item&, uint64_t>>;
+
+/// True when Hasher_t returns both base hashes in one call, as a hash_pair_t or (where supported) a
+/// 128-bit integer, instead of a single uint64_t
+template <typename Item, class Hasher_t>
+inline constexpr bool is_pair_hasher_v = std::is_same_v<hasher_result_t<Item, Hasher_t>, hash_pair_t>
+#if defined(__SIZEOF_INT128__)
+                                         || std::is_same_v<hasher_result_t<Item, Hasher_t>, __uint128_t>
+#endif
+    ;
+
+/// Split the result of a pair hasher into its two 64-bit halves
+[[nodiscard]] inline hash_pair_t to_hash_pair(const hash_pair_t& h) noexcept { return h; }
+#if defined(__SIZEOF_INT128__)
+[[nodiscard]] inline hash_pair_t to_hash_pair(__uint128_t h) noexcept
+{
+	return {static_cast<uint64_t>(h), static_cast<uint64_t>(h >> 64)};
+}
+#endif
+
 /// Xorshift-based hash generator using a single hash functor
 /// Based on Xorshift128* by Sebastiano Vigna (public domain)
+/// SingleHasher_t is either called twice with two seeds, or once when it returns a pair of hashes
+/// (see is_pair_hasher_v); in the latter case h1() reuses the value stored by h0() in the same state.
 template <typename Item, class SingleHasher_t> class XorshiftHashFunctors
 {
-	static_assert(std::is_invocable_r_v<uint64_t, const SingleHasher_t&, const Item&, uint64_t>,
-	              "SingleHasher_t::operator()(const Item&, uint64_t) must be const and return uint64_t");
+	static_assert(std::is_invocable_r_v<uint64_t, const SingleHasher_t&, const Item&, uint64_t> ||
+	                  is_pair_hasher_v<Item, SingleHasher_t>,
+	              "SingleHasher_t::operator()(const Item&, uint64_t) must be const and return uint64_t, "
+	              "hash_pair_t or a 128-bit integer");
+
+	static constexpr bool pair_hasher = is_pair_hasher_v<Item, SingleHasher_t>;
 
 	[[nodiscard]] uint64_t next(uint64_t* s) const
 	{
@@ -269,15 +165,40 @@ template <typename Item, class SingleHasher_t> class XorshiftHashFunctors
 	}
 
 public:
+	XorshiftHashFunctors() = default;
+
+	explicit XorshiftHashFunctors(uint64_t seed) { setSeed(seed); }
+
+	/// Perturb the two seeds handed to SingleHasher_t (seed 0 keeps the historical values)
+	void setSeed(uint64_t seed) noexcept
+	{
+		_seed = seed;
+		_seed0 = 0xAAAAAAAA55555555ULL + seed * 0x9E3779B97F4A7C15ULL;
+		_seed1 = 0x33333333CCCCCCCCULL + seed * 0xC2B2AE3D27D4EB4FULL;
+	}
+
+	[[nodiscard]] uint64_t seed() const noexcept { return _seed; }
+
 	[[nodiscard]] uint64_t h0(hash_pair_t& s, const Item& key) const
 	{
-		s[0] = singleHasher(key, 0xAAAAAAAA55555555ULL);
+		if constexpr (pair_hasher)
+		{
+			s = to_hash_pair(singleHasher(key, _seed0));
+		}
+		else
+		{
+			s[0] = singleHasher(key, _seed0);
+		}
 		return s[0];
 	}
 
+	/// Must follow h0() on the same state
 	[[nodiscard]] uint64_t h1(hash_pair_t& s, const Item& key) const
 	{
-		s[1] = singleHasher(key, 0x33333333CCCCCCCCULL);
+		if constexpr (!pair_hasher)
+		{
+			s[1] = singleHasher(key, _seed1);
+		}
 		return s[1];
 	}
 
@@ -292,13 +213,11 @@ public:
 
 	[[nodiscard]] hash_set_t operator()(const Item& key) const
 	{
-		uint64_t s[2];
+		hash_pair_t s;
 		hash_set_t hset;
 
-		hset[0] = singleHasher(key, 0xAAAAAAAA55555555ULL);
-		hset[1] = singleHasher(key, 0x33333333CCCCCCCCULL);
-		s[0] = hset[0];
-		s[1] = hset[1];
+		hset[0] = h0(s, key);
+		hset[1] = h1(s, key);
 
 		for (size_t ii = 2; ii < 10; ++ii)
 		{
@@ -309,6 +228,29 @@ public:
 
 private:
 	SingleHasher_t singleHasher;
+	uint64_t _seed{0};
+	uint64_t _seed0{0xAAAAAAAA55555555ULL};
+	uint64_t _seed1{0x33333333CCCCCCCCULL};
+};
+
+/// One-argument hash for the fallback std::unordered_map of the last level
+template <typename Item, class Hasher_t> class FallbackHasher
+{
+public:
+	[[nodiscard]] size_t operator()(const Item& key) const
+	{
+		if constexpr (is_pair_hasher_v<Item, Hasher_t>)
+		{
+			return static_cast<size_t>(to_hash_pair(_hasher(key, 0xAAAAAAAA55555555ULL))[0]);
+		}
+		else
+		{
+			return static_cast<size_t>(_hasher(key));
+		}
+	}
+
+private:
+	Hasher_t _hasher;
 };
 
 ////////////////////////////////////////////////////////////////
@@ -335,25 +277,148 @@ template <typename Iterator> [[nodiscard]] iter_range<Iterator> range(Iterator b
 // Level structure
 ////////////////////////////////////////////////////////////////
 
+/// How level hashes are reduced to a position in [0, p): modulo (fastrange64, the historical mapping kept for saved
+/// indexes), or multiply_shift64, which avoids a 64-bit division on every level probe
+enum class range_reduction : uint32_t
+{
+	modulo,
+	multiply_shift
+};
+
 [[nodiscard]] inline uint64_t fastrange64(uint64_t word, uint64_t p) { return word % p; }
 
+/// Lemire's fast range reduction: the high half of word * p. It maps by the high bits of word.
+[[nodiscard]] inline uint64_t multiply_shift64(uint64_t word, uint64_t p) noexcept
+{
+#if defined(__SIZEOF_INT128__)
+	return static_cast<uint64_t>((static_cast<__uint128_t>(word) * p) >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	uint64_t high;
+	static_cast<void>(_umul128(word, p, &high));
+	return high;
+#else
+	const uint64_t hw = word >> 32, hp = p >> 32, lw = static_cast<uint32_t>(word), lp = static_cast<uint32_t>(p);
+	const uint64_t hl = hw * lp;
+	const uint64_t cross = (lw * lp >> 32) + static_cast<uint32_t>(hl) + lw * hp; // at most 2^64 - 1
+	return hw * hp + (hl >> 32) + (cross >> 32);
+#endif
+}
+
 class level
 {
 public:
+	/// Bits of a line of the array shared by blocked levels
+	static constexpr uint64_t LINE_BITS = 512;
+	static constexpr uint32_t LINE_WORDS = LINE_BITS / 64;
+
 	level() = default;
 	~level() = default;
 
+	/// Position of hash_raw in the level, in [0, hash_domain)
+	[[nodiscard]] uint64_t slot(uint64_t hash_raw) const noexcept
+	{
+		if (line_words == 0)
+		{
+			return reduction == range_reduction::multiply_shift ? multiply_shift64(hash_raw, hash_domain)
+			                                                    : fastrange64(hash_raw, hash_domain);
+		}
+		uint64_t line, offset;
+		line_slot(hash_raw, line, offset);
+		return line * 64ULL * line_words + offset;
+	}
+
 	[[nodiscard]] uint64_t get(uint64_t hash_raw) const
 	{
-		const uint64_t hashi = fastrange64(hash_raw, hash_domain);
-		return bitset.get(hashi);
+		if (lines != nullptr)
+		{
+			return lines->get(line_bit(hash_raw));
+		}
+		const uint64_t hashi = slot(hash_raw);
+		return is_compressed ? compressed.get(hashi) : bitset.get(hashi);
+	}
+
+	/// Start loading the bit get(hash_raw) reads
+	void prefetch(uint64_t hash_raw) const noexcept
+	{
+		if (lines != nullptr)
+		{
+			lines->prefetch(line_bit(hash_raw));
+		}
+		else if (!is_compressed)
+		{
+			bitset.prefetch(slot(hash_raw));
+		}
+	}
+
+	/// Rank of the position of hash_raw among the positions of all levels (see bitVector::build_ranks)
+	[[nodiscard]] uint64_t rank(uint64_t hash_raw) const
+	{
+		if (lines != nullptr)
+		{
+			return lines->rank(line_bit(hash_raw));
+		}
+		const uint64_t hashi = slot(hash_raw);
+		return is_compressed ? compressed.rank(hashi) : bitset.rank(hashi);
+	}
+
+	[[nodiscard]] uint64_t bitSize() const noexcept { return is_compressed ? compressed.bitSize() : bitset.bitSize(); }
+
+	/// Line of a blocked level hash_raw falls in, and its slot among the level's slots of the line. With modulo, a
+	/// single division gives both: the remainder picks the line, the low half of the quotient the slot. With
+	/// multiply_shift, the high bits of hash_raw pick the line and its low half the slot.
+	void line_slot(uint64_t hash_raw, uint64_t& line, uint64_t& offset) const noexcept
+	{
+		const uint64_t slots = 64ULL * line_words;
+		if (reduction == range_reduction::multiply_shift)
+		{
+			line = multiply_shift64(hash_raw, nlines);
+			offset = (hash_raw & 0xffffffffULL) * slots >> 32;
+			return;
+		}
+		line = hash_raw % nlines;
+		offset = ((hash_raw / nlines) & 0xffffffffULL) * slots >> 32;
 	}
 
 	uint64_t idx_begin{0};
 	uint64_t hash_domain{0};
-	bitVector bitset;
+	range_reduction reduction{range_reduction::modulo};
+	bitVector bitset;        // emptied once the level is compressed or moved to shared lines
+	elias_fano compressed;
+	bool is_compressed{false};
+
+	// Blocked layout: the level owns words [line_first, line_first + line_words) of each of the nlines lines of an
+	// array shared with other levels (line_words is 0 for a level of its own). It is built as a plain array of
+	// line_words words per line, then moved to lines.
+	uint32_t line_words{0};
+	uint32_t line_first{0};
+	uint64_t nlines{0};
+	const bitVector* lines{nullptr};
+
+private:
+	[[nodiscard]] uint64_t line_bit(uint64_t hash_raw) const noexcept
+	{
+		uint64_t line, offset;
+		line_slot(hash_raw, line, offset);
+		return line * LINE_BITS + 64ULL * line_first + offset;
+	}
 };
 
+////////////////////////////////////////////////////////////////
+// Serialization format
+////////////////////////////////////////////////////////////////
+
+/// Tag written at the start of every saved mphf: the bytes "BBHASH\0\1" read as a little-endian uint64_t.
+/// Interpreted as a double it is far outside any valid gamma, which is what legacy files start with.
+constexpr uint64_t MPHF_FORMAT_MAGIC = 0x0100485341484242ULL;
+/// Version 2 appends the optional fingerprint array after the fallback table, version 3 appends flags after it,
+/// version 4 appends the Elias-Fano levels (see compressLevels), saved as empty bit arrays in the level list,
+/// version 5 appends the rank block size (rank directories are rebuilt on load), version 6 appends the words of
+/// level 0 per line of the blocked layout (0 without it) and then the array shared by levels 0 and 1, saved as empty
+/// bit arrays in the level list, version 7 adds MPHF_FLAG_MULTIPLY_SHIFT (older files use modulo)
+constexpr uint32_t MPHF_FORMAT_VERSION = 7;
+constexpr uint32_t MPHF_FLAG_NON_MINIMAL = 1;
+constexpr uint32_t MPHF_FLAG_MULTIPLY_SHIFT = 2;
+
 ////////////////////////////////////////////////////////////////
 // Threading
 ////////////////////////////////////////////////////////////////
@@ -373,22 +438,50 @@ template <typename Range, typename Iterator> struct thread_args
 template <typename elem_t, typename Hasher_t, typename Range, typename it_type>
 void thread_processLevel(thread_args<Range, it_type>* targ);
 
+/// Build options of mphf, beyond the original constructor parameters
+struct mphf_options
+{
+	/// Perturbs the hash functions; saved with the mphf
+	uint64_t seed{0};
+	/// With seed_retries > 0 the build is restarted with a new seed (up to that many times) whenever more than
+	/// fallbackThreshold() keys end up in the final fallback hash table
+	uint32_t seed_retries{0};
+	/// With minimal = false no rank structures are built and lookup() returns the raw position of a key in the
+	/// concatenated levels: a perfect hash into [0, hashRange()) that skips the rank computation.
+	bool minimal{true};
+	/// Fill levels through per-thread buffers by region (see slot_region_buffer) instead of one random atomic
+	/// update per key; the mphf built is the same.
+	bool partitioned_insert{false};
+	/// (experimental) Lay out levels 0 and 1 in shared 512-bit lines, a key's level-1 slot being in the line of its
+	/// level-0 slot (see blockedHash): a key missing level 0 finds level 1 in the same cache line.
+	bool blocked_levels{false};
+	/// How hashes are mapped to level positions; multiply_shift makes every probe cheaper but builds a different
+	/// mphf than the default modulo.
+	range_reduction reduction{range_reduction::modulo};
+};
+
 /// Minimal perfect hash function
-/// Hasher_t returns a single hash when operator()(elem_t key) is called
+/// Hasher_t returns a single hash when operator()(elem_t key, uint64_t seed) is called, or both base hashes at once
+/// as a hash_pair_t / 128-bit integer
 template <typename elem_t, typename Hasher_t> class mphf
 {
-	using MultiHasher_t = XorshiftHashFunctors<elem_t, Hasher_t>;
+	/// Owning key type used in buffers and spill files, and the type hashed and looked up (see key_traits)
+	using key_value_t = typename key_traits<elem_t>::value_type;
+	using key_view_t = typename key_traits<elem_t>::view_type;
+	using MultiHasher_t = XorshiftHashFunctors<key_view_t, Hasher_t>;
 
 public:
 	mphf() : _built(false) {}
 	~mphf() = default;
 
-	/// Construct MPHF from input range
+	/// Construct MPHF from input range; the build options beyond the original parameters are in mphf_options
 	template <typename Range>
 	mphf(uint64_t n, const Range& input_range, int num_thread = 1, double gamma = 2.0, bool writeEach = true,
-	     bool progress = true, float perc_elem_loaded = 0.03)
+	     bool progress = true, float perc_elem_loaded = 0.03, const mphf_options& options = {})
 	    : _gamma(gamma), _hash_domain(static_cast<uint64_t>(std::ceil(static_cast<double>(n) * gamma))), _nelem(n),
-	      _num_thread(num_thread), _percent_elem_loaded_for_fastMode(perc_elem_loaded), _withprogress(progress)
+	      _num_thread(num_thread), _percent_elem_loaded_for_fastMode(perc_elem_loaded), _withprogress(progress),
+	      _minimal(options.minimal), _partitionedInsert(options.partitioned_insert),
+	      _blockedLevels(options.blocked_levels), _reduction(options.reduction)
 	{
 
 		if (n == 0)
@@ -396,103 +489,193 @@ public:
 			return;
 		}
 
-		_fastmode = (_percent_elem_loaded_for_fastMode > 0.0);
 		_writeEachLevel = writeEach;
+		_hasher.setSeed(options.seed);
 
-		if (writeEach)
+		for (uint32_t attempt = 0;; ++attempt)
 		{
-			_fastmode = false;
+			build(input_range);
+
+			if (attempt >= options.seed_retries || _final_hash.size() <= fallbackThreshold())
+			{
+				break;
+			}
+			if (_withprogress)
+			{
+				std::printf("%zu keys in fallback level with seed %" PRIu64 ", rebuilding with a new seed\n",
+				            _final_hash.size(), _hasher.seed());
+			}
+			_hasher.setSeed(splitmix64(_hasher.seed()));
 		}
 
-		setup();
+		setLevelFastmode.release();
 
-		if (_withprogress)
+		std::lock_guard<std::mutex> lock(_mutex);
+		_built = true;
+	}
+
+	/// Lookup hash value for an element (string keys are looked up through std::string_view without allocating)
+	/// Keys outside the original set map to an arbitrary index, or to ULLONG_MAX when rejected by the fingerprints
+	/// (see addFingerprints()).
+	[[nodiscard]] uint64_t lookup(const key_view_t& elem) const
+	{
+		if (!_built)
 		{
-			_progressBar.timer_mode = 1;
+			return ULLONG_MAX;
+		}
 
-			const double total_raw = _nb_levels;
-			const double sum_geom_read = 1.0 / (1.0 - _proba_collision);
-			const double total_writeEach = sum_geom_read + 1.0;
-			const double total_fastmode_ram = (_fastModeLevel + 1) + (std::pow(_proba_collision, _fastModeLevel)) *
-			                                                             (_nb_levels - (_fastModeLevel + 1));
+		uint64_t level_hash;
+		const uint64_t idx = slot(elem, level_hash);
+		if (_fingerprints.size() != 0 && idx < _fingerprints.size() &&
+		    _fingerprints.get(idx) != fingerprint(level_hash))
+		{
+			return ULLONG_MAX;
+		}
+		return idx;
+	}
 
-			std::printf("for info, total work write each  : %.3f    total work inram from level %i : %.3f  total work "
-			            "raw : %.3f \n",
-			            total_writeEach, _fastModeLevel, total_fastmode_ram, total_raw);
+	/// Store a bits-wide fingerprint (1 to 16 bits) of every key at its index, so that lookup() returns ULLONG_MAX for
+	/// all but about 2^-bits of the keys outside the set. keys must be the key set the mphf was built from.
+	/// The fingerprint is taken from the hash of the level the key stops at, so lookups hash no more than before and
+	/// only read one more packed word. Random-access ranges are processed on num_thread threads.
+	template <typename Range> void addFingerprints(const Range& keys, uint32_t bits, int num_thread = 1)
+	{
+		if (bits == 0 || bits > MAX_FINGERPRINT_BITS)
+		{
+			throw std::invalid_argument("Fingerprints must have between 1 and 16 bits");
+		}
+		_fingerprints = packed_array(_hash_range, bits);
 
-			if (writeEach)
+		const auto store = [this](const key_view_t& key)
+		{
+			uint64_t level_hash;
+			const uint64_t idx = slot(key, level_hash);
+			if (idx < _fingerprints.size())
 			{
-				_progressBar.init(_nelem * static_cast<uint64_t>(total_writeEach), "Building BooPHF", num_thread);
+				_fingerprints.atomic_set(idx, fingerprint(level_hash));
 			}
-			else if (_fastmode)
+		};
+
+		using it_type = decltype(keys.begin());
+		if constexpr (std::is_base_of_v<std::random_access_iterator_tag,
+		                                typename std::iterator_traits<it_type>::iterator_category>)
+		{
+			const auto first = keys.begin();
+			const uint64_t n = static_cast<uint64_t>(keys.end() - first);
+			const uint64_t nthreads = static_cast<uint64_t>(std::max(1, num_thread));
+			const uint64_t slice = (n + nthreads - 1) / nthreads;
+			const auto run = [&](uint64_t begin, uint64_t end)
+			{
+				for (uint64_t i = begin; i < end; ++i)
+				{
+					store(first[static_cast<std::ptrdiff_t>(i)]);
+				}
+			};
+
+			std::vector<std::thread> workers;
+			for (uint64_t t = 1; t < nthreads; ++t)
 			{
-				_progressBar.init(_nelem * static_cast<uint64_t>(total_fastmode_ram), "Building BooPHF", num_thread);
+				workers.emplace_back(run, std::min(n, t * slice), std::min(n, (t + 1) * slice));
 			}
-			else
+			run(0, std::min(n, slice));
+			for (auto& w : workers)
 			{
-				_progressBar.init(_nelem * _nb_levels, "Building BooPHF", num_thread);
+				w.join();
 			}
 		}
-
-		uint64_t offset = 0;
-		for (uint32_t ii = 0; ii < _nb_levels; ++ii)
-		{
-			_tempBitset = new bitVector(_levels[ii].hash_domain);
-			processLevel(input_range, ii);
-			_levels[ii].bitset.clearCollisions(0, _levels[ii].hash_domain, _tempBitset);
-			offset = _levels[ii].bitset.build_ranks(offset);
-			delete _tempBitset;
-		}
-
-		if (_withprogress)
+		else
 		{
-			_progressBar.finish_threaded();
+			for (const auto& key : keys)
+			{
+				store(key);
+			}
 		}
+	}
 
-		_lastbitsetrank = offset;
-		std::vector<elem_t>().swap(setLevelFastmode);
-
-		std::lock_guard<std::mutex> lock(_mutex);
-		_built = true;
+	/// Width of the stored fingerprints, 0 when there are none
+	[[nodiscard]] uint32_t fingerprintBits() const noexcept
+	{
+		return _fingerprints.size() != 0 ? _fingerprints.width() : 0;
 	}
 
-	/// Lookup hash value for an element
-	[[nodiscard]] uint64_t lookup(const elem_t& elem) const
+	[[nodiscard]] uint64_t nbKeys() const noexcept { return _nelem; }
+
+	/// Rebuild the rank directories of the plain levels with one 16-bit count per block_bits bits (a power of two
+	/// from 64 to 4096; 128 by default). Smaller blocks make lookups scan fewer words, larger ones save memory.
+	void setRankSampling(uint32_t block_bits)
 	{
-		if (!_built)
+		if (!bitVector::valid_rank_block_bits(block_bits))
 		{
-			return ULLONG_MAX;
+			throw std::invalid_argument("rank block size must be a power of two between 64 and 4096 bits");
 		}
+		_rank_block_bits = block_bits;
+		rebuildRanks();
+	}
 
-		hash_pair_t bbhash;
-		int level;
-		const uint64_t level_hash = getLevel(bbhash, elem, &level);
+	[[nodiscard]] uint32_t rankSampling() const noexcept { return _rank_block_bits; }
 
-		if (level == static_cast<int>(_nb_levels) - 1)
+	/// Re-encode levels first_level and deeper as Elias-Fano sets wherever that is smaller than the plain bit array
+	/// with its rank samples; lookups answer get and rank on them in compressed form. Deep levels hold few keys but
+	/// each still pays for a full bit array, while the first levels are dense and hit by almost every lookup, so they
+	/// stay plain. Returns the number of levels compressed.
+	uint32_t compressLevels(uint32_t first_level = 2)
+	{
+		uint32_t ncompressed = 0;
+		for (uint32_t ii = first_level; ii < _nb_levels; ++ii)
 		{
-			const auto in_final_map = _final_hash.find(elem);
-			if (in_final_map == _final_hash.end())
+			auto& lvl = _levels[ii];
+			if (lvl.is_compressed || lvl.lines != nullptr)
 			{
-				return ULLONG_MAX; // Element not in original set
+				continue;
+			}
+			const uint64_t rank_base = _minimal && lvl.hash_domain != 0 ? lvl.bitset.rank(0) : 0;
+			elias_fano encoded(lvl.bitset, rank_base);
+			if (encoded.bitSize() < lvl.bitset.bitSize())
+			{
+				lvl.compressed = std::move(encoded);
+				lvl.bitset = bitVector();
+				lvl.is_compressed = true;
+				++ncompressed;
 			}
-			return in_final_map->second + _lastbitsetrank;
 		}
-
-		const uint64_t non_minimal_hp = fastrange64(level_hash, _levels[level].hash_domain);
-		return _levels[level].bitset.rank(non_minimal_hp);
+		return ncompressed;
 	}
 
-	[[nodiscard]] uint64_t nbKeys() const noexcept { return _nelem; }
+	/// False when built with minimal = false (lookup() skips the rank step)
+	[[nodiscard]] bool isMinimal() const noexcept { return _minimal; }
+
+	/// True when levels 0 and 1 share their cache lines (blocked_levels)
+	[[nodiscard]] bool hasBlockedLevels() const noexcept { return _blockedLineWords != 0; }
+
+	/// How hashes are mapped to level positions (persisted by save())
+	[[nodiscard]] range_reduction rangeReduction() const noexcept { return _reduction; }
+
+	/// Keys are looked up into [0, hashRange()): nbKeys() for a minimal hash, the used level positions plus the
+	/// fallback keys otherwise
+	[[nodiscard]] uint64_t hashRange() const noexcept { return _hash_range; }
+
+	/// Seed the hash functions were built with (persisted by save())
+	[[nodiscard]] uint64_t seed() const noexcept { return _hasher.seed(); }
+
+	/// Number of keys stored in the fallback hash table of the last level
+	[[nodiscard]] uint64_t nbFallbackKeys() const noexcept { return _final_hash.size(); }
+
+	/// Fallback size above which a build is retried with a new seed
+	[[nodiscard]] uint64_t fallbackThreshold() const noexcept
+	{
+		return std::max<uint64_t>(MIN_FALLBACK_RETRY_KEYS, _nelem / 1000);
+	}
 
 	uint64_t totalBitSize()
 	{
-		uint64_t totalsizeBitset = 0;
+		uint64_t totalsizeBitset = _blockedLines.bitSize();
 		for (uint32_t ii = 0; ii < _nb_levels; ++ii)
 		{
-			totalsizeBitset += _levels[ii].bitset.bitSize();
+			totalsizeBitset += _levels[ii].bitSize();
 		}
 
-		const uint64_t totalsize = totalsizeBitset + _final_hash.size() * 42 * 8;
+		const uint64_t fingerprint_bits = _fingerprints.size() != 0 ? _fingerprints.bitSize() : 0;
+		const uint64_t totalsize = totalsizeBitset + _final_hash.size() * 42 * 8 + fingerprint_bits;
 
 		std::cout << "Bitarray    " << totalsizeBitset << "  bits (" << std::fixed << std::setprecision(2)
 		          << (100 * static_cast<float>(totalsizeBitset) / totalsize) << "% )   (array + ranks )\n";
@@ -500,11 +683,17 @@ public:
 		std::cout << "Last level hash  " << last_level_bits << "  bits (" << std::fixed << std::setprecision(2)
 		          << (100 * static_cast<float>(last_level_bits) / totalsize) << "% ) (nb in last level hash "
 		          << _final_hash.size() << ")\n";
+		if (fingerprint_bits != 0)
+		{
+			std::cout << "Fingerprints  " << fingerprint_bits << "  bits (" << std::fixed << std::setprecision(2)
+			          << (100 * static_cast<float>(fingerprint_bits) / totalsize) << "% ) (" << fingerprintBits()
+			          << " bits per key)\n";
+		}
 		return totalsize;
 	}
 
 	template <typename Iterator>
-	void pthread_processLevel(std::vector<elem_t>& buffer, std::shared_ptr<Iterator> shared_it,
+	void pthread_processLevel(std::vector<key_value_t>& buffer, std::shared_ptr<Iterator> shared_it,
 	                          std::shared_ptr<Iterator> until_p, int i)
 	{
 		uint64_t nb_done = 0;
@@ -514,128 +703,227 @@ public:
 			tid = _nb_living++;
 		}
 		auto until = *until_p;
-		uint64_t inbuff = 0;
 
 		uint64_t writebuff = 0;
-		std::vector<elem_t>& myWriteBuff = bufferperThread[tid];
+		std::vector<key_value_t>& myWriteBuff = bufferperThread[tid];
+
+		std::unique_ptr<slot_region_buffer> regions;
+		if (_partitionedInsert && i < static_cast<int>(_nb_levels) - 1 &&
+		    _levels[i].hash_domain >= PARTITIONED_INSERT_MIN_SLOTS)
+		{
+			regions = std::make_unique<slot_region_buffer>(*_levelSlots);
+		}
+
+		// Keys go through in windows of PIPELINE_WINDOW, so that their random memory accesses overlap instead of
+		// running one after the other: hash every key and prefetch the first bit it tests, then walk the levels and
+		// prefetch the slot each key reaching level i goes to, then insert them.
+		const auto last_level = static_cast<int>(_nb_levels) - 1;
+		const int first_tested = _writeEachLevel ? std::max(i - 1, 0) : 0; // keys read from a level file are past i - 1
+		std::array<hash_pair_t, PIPELINE_WINDOW> bbhash{};
+		std::array<uint64_t, PIPELINE_WINDOW> hashes; // hash of the next level to test, then of level i
+		std::array<bool, PIPELINE_WINDOW> reached;
+
+		auto hash_first = [&](size_t k, const auto& val)
+		{
+			uint64_t h = levelHash(bbhash[k], val, 0, 0);
+			for (int j = 1; j <= first_tested; ++j)
+			{
+				h = levelHash(bbhash[k], val, j, h);
+			}
+			hashes[k] = h;
+			if (first_tested < i)
+			{
+				_levels[first_tested].prefetch(h);
+			}
+			else if (i < last_level)
+			{
+				_levelSlots->prefetch(_levels[i].slot(h));
+			}
+		};
 
-		for (bool isRunning = true; isRunning;)
+		auto walk_levels = [&](size_t k, const auto& val)
 		{
-			// Safely copy items into buffer
+			uint64_t h = hashes[k];
+			for (int j = first_tested; j < i; ++j)
 			{
-				std::lock_guard<std::mutex> lock(_mutex);
-				for (; inbuff < NBBUFF && (*shared_it) != until; ++(*shared_it))
+				if (_levels[j].get(h))
 				{
-					buffer[inbuff++] = *(*shared_it);
+					reached[k] = false;
+					return;
 				}
-				if ((*shared_it) == until)
+				h = levelHash(bbhash[k], val, j + 1, h);
+			}
+			hashes[k] = h;
+			reached[k] = true;
+			if (i < last_level && first_tested < i)
+			{
+				_levelSlots->prefetch(_levels[i].slot(h));
+			}
+		};
+
+		auto place = [&](size_t k, const auto& val)
+		{
+			if (_fastmode && i == _fastModeLevel)
+			{
+				std::lock_guard<std::mutex> lock(_idxLevel_mutex);
+				if (!setLevelFastmode.push(val))
 				{
-					isRunning = false;
+					_fastmode = false;
 				}
 			}
 
-			// Process buffered elements
-			for (uint64_t ii = 0; ii < inbuff; ++ii)
+			// Insert into next level or final hash
+			if (i == last_level)
+			{
+				std::lock_guard<std::mutex> lock(_final_hash_mutex);
+				insertFallback(val, _hashidx++);
+				return;
+			}
+			if (_writeEachLevel && i > 0)
 			{
-				const elem_t val = buffer[ii];
+				myWriteBuff[writebuff++] = val;
+				if (writebuff >= NBBUFF)
+				{
+					write_keys_with_file_lock(_currlevelFile, myWriteBuff, writebuff);
+					writebuff = 0;
+				}
+			}
+			insertIntoLevel(hashes[k], i, regions.get());
+		};
 
-				hash_pair_t bbhash;
-				int level;
-				if (_writeEachLevel)
+		// first is a random-access iterator; keys are dereferenced again at each stage, never stored
+		auto process = [&](auto first, uint64_t count)
+		{
+			for (uint64_t done = 0; done < count; done += PIPELINE_WINDOW)
+			{
+				const auto n = static_cast<size_t>(std::min<uint64_t>(PIPELINE_WINDOW, count - done));
+				const auto window = first + static_cast<std::ptrdiff_t>(done);
+				for (size_t k = 0; k < n; ++k)
 				{
-					[[maybe_unused]] auto ignored = getLevel(bbhash, val, &level, i, i - 1);
+					hash_first(k, window[static_cast<std::ptrdiff_t>(k)]);
 				}
-				else
+				for (size_t k = 0; k < n; ++k)
 				{
-					[[maybe_unused]] auto ignored = getLevel(bbhash, val, &level, i);
+					walk_levels(k, window[static_cast<std::ptrdiff_t>(k)]);
 				}
-
-				if (level == i)
+				for (size_t k = 0; k < n; ++k)
 				{
-					if (_fastmode && i == _fastModeLevel)
+					if (reached[k])
 					{
-						uint64_t idxl2;
-						{
-							std::lock_guard<std::mutex> lock(_idxLevel_mutex);
-							idxl2 = _idxLevelsetLevelFastmode++;
-						}
-						if (idxl2 >= static_cast<uint64_t>(setLevelFastmode.size()))
-						{
-							_fastmode = false;
-						}
-						else
-						{
-							setLevelFastmode[static_cast<size_t>(idxl2)] = val;
-						}
+						place(k, window[static_cast<std::ptrdiff_t>(k)]);
 					}
+				}
+			}
 
-					// Insert into next level or final hash
-					if (i == static_cast<int>(_nb_levels) - 1)
-					{
-						uint64_t hashidx;
-						{
-							std::lock_guard<std::mutex> lock(_final_hash_mutex);
-							hashidx = _hashidx++;
-							_final_hash[val] = hashidx;
-						}
-					}
-					else
+			nb_done += count;
+			if (nb_done >= 1024 && _withprogress)
+			{
+				_progressBar.inc(nb_done, tid);
+				nb_done = 0;
+			}
+		};
+
+		if constexpr (is_chunked_iterator_v<Iterator>)
+		{
+			// Chunked key files: claim a whole chunk under the lock and decode it on this thread
+			const auto* source = shared_it->source();
+			std::vector<typename std::iterator_traits<Iterator>::value_type> chunk;
+			for (;;)
+			{
+				uint64_t c;
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					if (*shared_it == until)
 					{
-						if (_writeEachLevel && i > 0 && i < static_cast<int>(_nb_levels) - 1)
-						{
-							myWriteBuff[writebuff++] = val;
-							if (writebuff >= NBBUFF)
-							{
-								write_with_file_lock(_currlevelFile, myWriteBuff, writebuff);
-								writebuff = 0;
-							}
-						}
-
-						// Compute next hash
-						uint64_t level_hash;
-						if (level == 0)
-						{
-							level_hash = _hasher.h0(bbhash, val);
-						}
-						else if (level == 1)
-						{
-							level_hash = _hasher.h1(bbhash, val);
-						}
-						else
-						{
-							level_hash = _hasher.next(bbhash);
-						}
-						insertIntoLevel(level_hash, i);
+						break;
 					}
+					c = shared_it->claim_chunk();
 				}
-
-				++nb_done;
-				if ((nb_done & 1023) == 0 && _withprogress)
+				source->decode_chunk(c, chunk);
+				process(chunk.cbegin(), chunk.size());
+			}
+		}
+		else if constexpr (std::is_base_of_v<std::random_access_iterator_tag,
+		                                     typename std::iterator_traits<Iterator>::iterator_category>)
+		{
+			// Random-access input (vectors, mapped files, fast-mode storage): claim a chunk under the lock and
+			// read the keys in place, so threads never wait on each other's reads
+			for (;;)
+			{
+				Iterator first;
+				Iterator last;
 				{
-					_progressBar.inc(nb_done, tid);
-					nb_done = 0;
+					std::lock_guard<std::mutex> lock(_mutex);
+					first = *shared_it;
+					const auto step = std::min<std::ptrdiff_t>(static_cast<std::ptrdiff_t>(NBBUFF), until - first);
+					last = first + step;
+					*shared_it = last;
 				}
+				if (first == last)
+				{
+					break;
+				}
+				process(first, static_cast<uint64_t>(last - first));
 			}
+		}
+		else
+		{
+			uint64_t inbuff = 0;
+			for (bool isRunning = true; isRunning;)
+			{
+				// Safely copy items into buffer
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					for (; inbuff < NBBUFF && (*shared_it) != until; ++(*shared_it))
+					{
+						buffer[inbuff++] = *(*shared_it);
+					}
+					if ((*shared_it) == until)
+					{
+						isRunning = false;
+					}
+				}
+
+				// Process buffered elements
+				process(buffer.cbegin(), inbuff);
 
-			inbuff = 0;
+				inbuff = 0;
+			}
 		}
 
 		if (_writeEachLevel && writebuff > 0)
 		{
-			write_with_file_lock(_currlevelFile, myWriteBuff, writebuff);
+			write_keys_with_file_lock(_currlevelFile, myWriteBuff, writebuff);
+		}
+		if (regions)
+		{
+			regions->flush();
 		}
 	}
 
 	void save(std::ostream& os) const
 	{
+		write_le(os, MPHF_FORMAT_MAGIC);
+		write_le(os, MPHF_FORMAT_VERSION);
+		write_le(os, _hasher.seed());
+
 		write_le(os, _gamma);
 		write_le(os, _nb_levels);
 		write_le(os, _lastbitsetrank);
 		write_le(os, _nelem);
 
+		uint32_t ncompressed = 0;
 		for (uint32_t ii = 0; ii < _nb_levels; ++ii)
 		{
-			_levels[ii].bitset.save(os);
+			if (_levels[ii].is_compressed || _levels[ii].lines != nullptr)
+			{
+				bitVector(0).save(os);
+				ncompressed += _levels[ii].is_compressed ? 1 : 0;
+			}
+			else
+			{
+				_levels[ii].bitset.save(os);
+			}
 		}
 
 		// Save final hash table
@@ -644,14 +932,60 @@ public:
 
 		for (const auto& kv_pair : _final_hash)
 		{
-			write_le(os, kv_pair.first);
+			key_traits<elem_t>::write(os, kv_pair.first);
 			write_le(os, kv_pair.second);
 		}
+
+		write_le(os, fingerprintBits());
+		if (fingerprintBits() != 0)
+		{
+			_fingerprints.save(os);
+		}
+		write_le(os, (_minimal ? 0u : MPHF_FLAG_NON_MINIMAL) |
+		                 (_reduction == range_reduction::multiply_shift ? MPHF_FLAG_MULTIPLY_SHIFT : 0u));
+
+		write_le(os, ncompressed);
+		for (uint32_t ii = 0; ii < _nb_levels; ++ii)
+		{
+			if (_levels[ii].is_compressed)
+			{
+				write_le(os, ii);
+				_levels[ii].compressed.save(os);
+			}
+		}
+
+		write_le(os, _rank_block_bits);
+
+		write_le(os, _blockedLineWords);
+		if (_blockedLineWords != 0)
+		{
+			_blockedLines.save(os);
+		}
 	}
 
 	void load(std::istream& is)
 	{
-		read_le(is, _gamma);
+		// Files written before the format header start directly with gamma (version 0, seed 0)
+		uint64_t magic;
+		read_le(is, magic);
+		uint64_t seed = 0;
+		uint32_t version = 0;
+		if (magic == MPHF_FORMAT_MAGIC)
+		{
+			read_le(is, version);
+			if (version > MPHF_FORMAT_VERSION)
+			{
+				throw std::runtime_error("Unsupported mphf format version " + std::to_string(version));
+			}
+			read_le(is, seed);
+			read_le(is, _gamma);
+		}
+		else
+		{
+			std::memcpy(&_gamma, &magic, sizeof(_gamma));
+		}
+		_hasher.setSeed(seed);
+
 		read_le(is, _nb_levels);
 		read_le(is, _lastbitsetrank);
 		read_le(is, _nelem);
@@ -661,45 +995,259 @@ public:
 		for (uint32_t ii = 0; ii < _nb_levels; ++ii)
 		{
 			_levels[ii].bitset.load(is);
+			_levels[ii].compressed = elias_fano();
+			_levels[ii].is_compressed = false;
 		}
 
-		// Recompute level parameters
+		// Recompute level parameters (the domains once the layout is known, below)
 		_proba_collision =
 		    1.0 -
 		    std::pow(((_gamma * static_cast<double>(_nelem) - 1) / (_gamma * static_cast<double>(_nelem))), _nelem - 1);
-		uint64_t previous_idx = 0;
 		_hash_domain = static_cast<uint64_t>(std::ceil(static_cast<double>(_nelem) * _gamma));
 
-		for (uint32_t ii = 0; ii < _nb_levels; ++ii)
-		{
-			_levels[ii].idx_begin = previous_idx;
-			const double domain_d = static_cast<double>(_hash_domain) * std::pow(_proba_collision, ii);
-			uint64_t domain = static_cast<uint64_t>(std::ceil(domain_d));
-			_levels[ii].hash_domain = (domain + 63ULL) / 64ULL * 64ULL;
-			if (_levels[ii].hash_domain == 0)
-			{
-				_levels[ii].hash_domain = 64ULL;
-			}
-			previous_idx += _levels[ii].hash_domain;
-		}
-
 		// Restore final hash table
 		_final_hash.clear();
+		_final_arena.clear();
 		uint64_t final_hash_size;
 		read_le(is, final_hash_size);
 
 		for (uint64_t ii = 0; ii < final_hash_size; ++ii)
 		{
-			elem_t key;
+			key_value_t key;
 			uint64_t value;
-			read_le(is, key);
+			key_traits<elem_t>::read(is, key);
 			read_le(is, value);
-			_final_hash[key] = value;
+			insertFallback(key, value);
+		}
+
+		_fingerprints = packed_array();
+		uint32_t fingerprint_bits = 0;
+		if (version >= 2)
+		{
+			read_le(is, fingerprint_bits);
+		}
+		if (fingerprint_bits != 0)
+		{
+			_fingerprints.load(is);
+		}
+		uint32_t flags = 0;
+		if (version >= 3)
+		{
+			read_le(is, flags);
+		}
+		_minimal = (flags & MPHF_FLAG_NON_MINIMAL) == 0;
+		_reduction = version >= 7 && (flags & MPHF_FLAG_MULTIPLY_SHIFT) != 0 ? range_reduction::multiply_shift
+		                                                                     : range_reduction::modulo;
+
+		uint32_t ncompressed = 0;
+		if (version >= 4)
+		{
+			read_le(is, ncompressed);
+		}
+		for (uint32_t jj = 0; jj < ncompressed; ++jj)
+		{
+			uint32_t ii;
+			read_le(is, ii);
+			if (ii >= _nb_levels)
+			{
+				throw std::runtime_error("Corrupted mphf: compressed level out of range");
+			}
+			_levels[ii].compressed.load(is);
+			_levels[ii].bitset = bitVector();
+			_levels[ii].is_compressed = true;
+		}
+
+		_rank_block_bits = static_cast<uint32_t>(bitVector::DEFAULT_RANK_BLOCK_BITS);
+		if (version >= 5)
+		{
+			read_le(is, _rank_block_bits);
+			if (!bitVector::valid_rank_block_bits(_rank_block_bits))
+			{
+				throw std::runtime_error("Corrupted mphf rank block size");
+			}
+		}
+
+		_blockedLineWords = 0;
+		_blockedLines = bitVector();
+		if (version >= 6)
+		{
+			read_le(is, _blockedLineWords);
+			if (_blockedLineWords >= level::LINE_WORDS || (_blockedLineWords != 0 && _nb_levels < 2))
+			{
+				throw std::runtime_error("Corrupted mphf blocked levels");
+			}
+		}
+		setLevelDomains();
+		if (_blockedLineWords != 0)
+		{
+			_blockedLines.load(is);
+			if (_blockedLines.size() != _levels[0].nlines * level::LINE_BITS)
+			{
+				throw std::runtime_error("Corrupted mphf blocked levels");
+			}
+			_levels[0].lines = &_blockedLines;
+			_levels[1].lines = &_blockedLines;
+		}
+		rebuildRanks();
+		updateHashRange();
+		if (fingerprint_bits != 0 &&
+		    (_fingerprints.width() != fingerprint_bits || _fingerprints.size() != _hash_range))
+		{
+			throw std::runtime_error("Corrupted mphf fingerprints");
 		}
 		_built = true;
 	}
 
 private:
+	/// Index of an element without the fingerprint check; level_hash receives the hash of the level it stopped at
+	[[nodiscard]] uint64_t slot(const key_view_t& elem, uint64_t& level_hash) const
+	{
+		hash_pair_t bbhash{};
+		int level;
+		level_hash = getLevel(bbhash, elem, &level);
+
+		if (level == static_cast<int>(_nb_levels) - 1)
+		{
+			const auto in_final_map = _final_hash.find(elem);
+			if (in_final_map == _final_hash.end())
+			{
+				return ULLONG_MAX; // Element not in original set
+			}
+			return in_final_map->second + _lastbitsetrank;
+		}
+
+		const uint64_t non_minimal_hp = _levels[level].slot(level_hash);
+		if (!_minimal)
+		{
+			return _levels[level].idx_begin + non_minimal_hp;
+		}
+		return _levels[level].rank(level_hash);
+	}
+
+	/// The position only uses level_hash modulo the level size, so a mix of all its bits is close to independent of it
+	[[nodiscard]] uint64_t fingerprint(uint64_t level_hash) const noexcept
+	{
+		return fmix64(level_hash ^ 0x9E3779B97F4A7C15ULL) >> (64 - _fingerprints.width());
+	}
+
+	/// Run one full construction pass over the input with the current hasher seed
+	template <typename Range> void build(const Range& input_range)
+	{
+		_fastmode = (_percent_elem_loaded_for_fastMode > 0.0);
+		if (_writeEachLevel)
+		{
+			_fastmode = false;
+		}
+		_final_hash.clear();
+		_final_arena.clear();
+
+		setup();
+
+		if (_withprogress)
+		{
+			_progressBar.timer_mode = 1;
+
+			const double total_raw = _nb_levels;
+			const double sum_geom_read = 1.0 / (1.0 - _proba_collision);
+			const double total_writeEach = sum_geom_read + 1.0;
+			const double total_fastmode_ram = (_fastModeLevel + 1) + (std::pow(_proba_collision, _fastModeLevel)) *
+			                                                             (_nb_levels - (_fastModeLevel + 1));
+
+			std::printf("for info, total work write each  : %.3f    total work inram from level %i : %.3f  total work "
+			            "raw : %.3f \n",
+			            total_writeEach, _fastModeLevel, total_fastmode_ram, total_raw);
+
+			if (_writeEachLevel)
+			{
+				_progressBar.init(_nelem * static_cast<uint64_t>(total_writeEach), "Building BooPHF", _num_thread);
+			}
+			else if (_fastmode)
+			{
+				_progressBar.init(_nelem * static_cast<uint64_t>(total_fastmode_ram), "Building BooPHF", _num_thread);
+			}
+			else
+			{
+				_progressBar.init(_nelem * _nb_levels, "Building BooPHF", _num_thread);
+			}
+		}
+
+		// offset: keys placed so far (minimal), or end of the last level holding a key (non-minimal); the fallback
+		// keys are numbered from there
+		uint64_t offset = 0;
+		for (uint32_t ii = 0; ii < _nb_levels; ++ii)
+		{
+			processLevel(input_range, ii);
+			// The slots holding exactly one key become the level, in place in the slot state buffer; minimal levels
+			// get their ranks in the same pass
+			const bool blocked = _blockedLineWords != 0 && ii < 2;
+			_levels[ii].bitset = std::move(*_levelSlots)
+			                         .to_bitvector(offset, _minimal && !blocked ? _rank_block_bits : 0, _num_thread);
+			_levelSlots.reset();
+			if (blocked)
+			{
+				// Levels 0 and 1 are ranked together once they share their lines
+				if (!_minimal && _levels[ii].bitset.any())
+				{
+					offset = _levels[ii].idx_begin + _levels[ii].hash_domain;
+				}
+				if (ii == 1)
+				{
+					mergeBlockedLevels();
+					if (_minimal)
+					{
+						offset = _blockedLines.build_ranks(0, _rank_block_bits, _num_thread);
+					}
+				}
+			}
+			else if (!_minimal && ii < _nb_levels - 1 && _levels[ii].bitset.any())
+			{
+				offset = _levels[ii].idx_begin + _levels[ii].hash_domain;
+			}
+		}
+
+		if (_withprogress)
+		{
+			_progressBar.finish_threaded();
+		}
+
+		_lastbitsetrank = offset;
+		updateHashRange();
+	}
+
+	/// Rebuild the plain levels' rank directories whose block size differs from _rank_block_bits, keeping their base
+	void rebuildRanks()
+	{
+		const auto rebuild = [this](bitVector& bits)
+		{
+			if (bits.has_ranks() && bits.rankBlockBits() != _rank_block_bits)
+			{
+				[[maybe_unused]] auto total = bits.build_ranks(bits.rank(0), _rank_block_bits);
+			}
+		};
+		for (auto& lvl : _levels)
+		{
+			if (!lvl.is_compressed)
+			{
+				rebuild(lvl.bitset);
+			}
+		}
+		rebuild(_blockedLines);
+	}
+
+	/// Fallback ids follow _lastbitsetrank; duplicated keys may leave gaps among them, hence the max
+	void updateHashRange()
+	{
+		_hash_range = _nelem;
+		if (!_minimal)
+		{
+			_hash_range = _lastbitsetrank;
+			for (const auto& kv_pair : _final_hash)
+			{
+				_hash_range = std::max(_hash_range, _lastbitsetrank + kv_pair.second + 1);
+			}
+		}
+	}
+
 	void setup()
 	{
 		const uint64_t tid_hash = std::hash<std::thread::id>{}(std::this_thread::get_id());
@@ -709,7 +1257,7 @@ private:
 
 		if (_fastmode)
 		{
-			setLevelFastmode.resize(
+			setLevelFastmode.reset(
 			    static_cast<size_t>(_percent_elem_loaded_for_fastMode * static_cast<double>(_nelem)));
 		}
 
@@ -729,22 +1277,19 @@ private:
 		_nb_levels = 25;
 		_levels.resize(_nb_levels);
 
-		// Build level structures
-		uint64_t previous_idx = 0;
-		for (uint32_t ii = 0; ii < _nb_levels; ++ii)
+		// Blocked layout: split each line between levels 0 and 1 in the ratio of their domains, rounded in favour of
+		// level 1. Keys crowd in the lines with many level-0 collisions, so level 1 needs more room than gamma to send
+		// no more keys to level 2 than the deeper levels are sized for. Lines are numbered on 32 bits (see
+		// blockedHash), which covers levels of up to 2^40 slots.
+		_blockedLineWords = 0;
+		if (_blockedLevels && _hash_domain < (1ULL << 40))
 		{
-			_levels[ii].idx_begin = previous_idx;
-
-			// Round size to nearest superior multiple of 64
-			const double domain_d = static_cast<double>(_hash_domain) * std::pow(_proba_collision, ii);
-			uint64_t domain = static_cast<uint64_t>(std::ceil(domain_d));
-			_levels[ii].hash_domain = (domain + 63ULL) / 64ULL * 64ULL;
-			if (_levels[ii].hash_domain == 0)
-			{
-				_levels[ii].hash_domain = 64ULL;
-			}
-			previous_idx += _levels[ii].hash_domain;
+			const double level1_words = level::LINE_WORDS * _proba_collision / (1.0 + _proba_collision);
+			_blockedLineWords =
+			    level::LINE_WORDS - std::clamp<uint32_t>(static_cast<uint32_t>(std::ceil(level1_words)), 1,
+			                                             level::LINE_WORDS / 2);
 		}
+		setLevelDomains();
 
 		for (uint32_t ii = 0; ii < _nb_levels; ++ii)
 		{
@@ -757,7 +1302,7 @@ private:
 	}
 
 	/// Compute level for element and return hash of last level reached
-	[[nodiscard]] uint64_t getLevel(hash_pair_t& bbhash, const elem_t& val, int* res_level, int maxlevel = 100,
+	[[nodiscard]] uint64_t getLevel(hash_pair_t& bbhash, const key_view_t& val, int* res_level, int maxlevel = 100,
 	                                int minlevel = 0) const
 	{
 		int level = 0;
@@ -765,44 +1310,146 @@ private:
 
 		for (uint32_t ii = 0; ii < (_nb_levels - 1) && ii < static_cast<uint32_t>(maxlevel); ++ii)
 		{
-			// Compute next hash
-			if (ii == 0)
+			hash_raw = levelHash(bbhash, val, static_cast<int>(ii), hash_raw);
+			if (ii >= static_cast<uint32_t>(minlevel) && _levels[ii].get(hash_raw))
 			{
-				hash_raw = _hasher.h0(bbhash, val);
+				break;
 			}
-			else if (ii == 1)
+			++level;
+		}
+
+		*res_level = level;
+		return hash_raw;
+	}
+
+	/// Hash of level j for a key, given its hash of level j - 1; must be called for j = 0, 1, 2... in turn on the
+	/// same state
+	[[nodiscard]] uint64_t levelHash(hash_pair_t& bbhash, const key_view_t& val, int j, uint64_t previous) const
+	{
+		if (j == 0)
+		{
+			return _hasher.h0(bbhash, val);
+		}
+		if (j == 1)
+		{
+			const uint64_t h1 = _hasher.h1(bbhash, val);
+			return _blockedLineWords != 0 ? blockedHash(previous, h1) : h1;
+		}
+		return _hasher.next(bbhash);
+	}
+
+	/// Level-1 hash of the blocked layout: the line of the level-0 slot of h0, and a slot picked by h1 among the
+	/// level-1 slots of that line (see level::line_slot). With multiply_shift, the high half of h0 is kept, which
+	/// lands in the same line or an adjacent one.
+	[[nodiscard]] uint64_t blockedHash(uint64_t h0, uint64_t h1) const
+	{
+		if (_reduction == range_reduction::multiply_shift)
+		{
+			return (h0 & 0xffffffff00000000ULL) | (h1 & 0xffffffffULL);
+		}
+		const uint64_t nlines = _levels[0].nlines;
+		return h0 % nlines + nlines * (h1 >> 32);
+	}
+
+	/// Hash domain and first index of every level. With the blocked layout, levels 0 and 1 get the same number of
+	/// lines, _blockedLineWords words of each for level 0 and the others for level 1.
+	void setLevelDomains()
+	{
+		uint64_t previous_idx = 0;
+		for (uint32_t ii = 0; ii < _nb_levels; ++ii)
+		{
+			auto& lvl = _levels[ii];
+			lvl.idx_begin = previous_idx;
+
+			// Round size to nearest superior multiple of 64
+			const double domain_d = static_cast<double>(_hash_domain) * std::pow(_proba_collision, ii);
+			uint64_t domain = static_cast<uint64_t>(std::ceil(domain_d));
+			lvl.hash_domain = (domain + 63ULL) / 64ULL * 64ULL;
+			if (lvl.hash_domain == 0)
 			{
-				hash_raw = _hasher.h1(bbhash, val);
+				lvl.hash_domain = 64ULL;
 			}
-			else
+
+			lvl.reduction = _reduction;
+			lvl.line_words = 0;
+			lvl.line_first = 0;
+			lvl.nlines = 0;
+			lvl.lines = nullptr;
+			if (_blockedLineWords != 0 && ii < 2)
 			{
-				hash_raw = _hasher.next(bbhash);
+				const uint64_t level0_slots = 64ULL * _blockedLineWords;
+				lvl.nlines = ii == 0 ? (lvl.hash_domain + level0_slots - 1) / level0_slots : _levels[0].nlines;
+				lvl.line_words = ii == 0 ? _blockedLineWords : level::LINE_WORDS - _blockedLineWords;
+				lvl.line_first = ii == 0 ? 0 : _blockedLineWords;
+				lvl.hash_domain = lvl.nlines * 64ULL * lvl.line_words;
 			}
-			if (ii >= static_cast<uint32_t>(minlevel) && _levels[ii].get(hash_raw))
+			previous_idx += lvl.hash_domain;
+		}
+	}
+
+	/// Interleave the bit arrays of levels 0 and 1 line by line into _blockedLines, which they read from then on
+	void mergeBlockedLevels()
+	{
+		auto& first = _levels[0];
+		auto& second = _levels[1];
+		bitVector merged(first.nlines * level::LINE_BITS);
+		for (uint64_t line = 0; line < first.nlines; ++line)
+		{
+			for (const level* lvl : {&first, &second})
 			{
-				break;
+				for (uint32_t w = 0; w < lvl->line_words; ++w)
+				{
+					merged.set64(line * level::LINE_WORDS + lvl->line_first + w,
+					             lvl->bitset.get64(line * lvl->line_words + w));
+				}
 			}
-			++level;
 		}
+		_blockedLines = std::move(merged);
+		for (level* lvl : {&first, &second})
+		{
+			lvl->bitset = bitVector();
+			lvl->lines = &_blockedLines;
+		}
+	}
 
-		*res_level = level;
-		return hash_raw;
+	/// Record a key reaching the last level; variable-length keys are copied into _final_arena so the map can
+	/// hold views. Called with _final_hash_mutex held.
+	void insertFallback(const key_view_t& val, uint64_t hashidx)
+	{
+		if constexpr (key_traits<elem_t>::variable_length)
+		{
+			const auto found = _final_hash.find(val);
+			if (found != _final_hash.end())
+			{
+				found->second = hashidx;
+				return;
+			}
+			_final_hash.emplace(_final_arena.intern(val), hashidx);
+		}
+		else
+		{
+			_final_hash[val] = hashidx;
+		}
 	}
 
-	/// Insert element into bit array level
-	void insertIntoLevel(uint64_t level_hash, int i)
+	/// Count element in its slot of the level under construction, directly or through the thread's region buffer
+	void insertIntoLevel(uint64_t level_hash, int i, slot_region_buffer* regions)
 	{
-		const uint64_t hashl = fastrange64(level_hash, _levels[i].hash_domain);
-		if (_levels[i].bitset.atomic_test_and_set(hashl))
+		const uint64_t pos = _levels[i].slot(level_hash);
+		if (regions != nullptr)
+		{
+			regions->insert(pos);
+		}
+		else
 		{
-			[[maybe_unused]] auto ignored = _tempBitset->atomic_test_and_set(hashl);
+			_levelSlots->insert(pos);
 		}
 	}
 
 	/// Process elements at level i
 	template <typename Range> void processLevel(const Range& input_range, int i)
 	{
-		_levels[i].bitset = bitVector(_levels[i].hash_domain);
+		_levelSlots = std::make_unique<slot_states>(_levels[i].hash_domain);
 
 		const std::string fname_old = "temp_p" + std::to_string(_pid) + "_level_" + std::to_string(i - 2) + ".tmp";
 		const std::string fname_curr = "temp_p" + std::to_string(_pid) + "_level_" + std::to_string(i) + ".tmp";
@@ -823,22 +1470,17 @@ private:
 
 		_cptLevel = 0;
 		_hashidx = 0;
-		_idxLevelsetLevelFastmode = 0;
 		_nb_living = 0;
 
 		// Create threads
 		std::vector<std::thread> tab_threads;
 		tab_threads.reserve(_num_thread);
 		using it_type = decltype(input_range.begin());
-		thread_args<Range, it_type> t_arg;
-		t_arg.boophf = this;
-		t_arg.range = &input_range;
-		t_arg.it_p = std::static_pointer_cast<void>(std::make_shared<it_type>(input_range.begin()));
-		t_arg.until_p = std::static_pointer_cast<void>(std::make_shared<it_type>(input_range.end()));
-		t_arg.level = i;
 
 		// Prepare iterator sources for this level
-		std::unique_ptr<file_binary<elem_t>> data_iterator_level_ptr;
+		using spill_file_t =
+		    std::conditional_t<key_traits<elem_t>::variable_length, file_strings, file_binary<key_value_t>>;
+		std::unique_ptr<spill_file_t> data_iterator_level_ptr;
 		
 		auto launch_workers = [&](auto start_it, auto until_it)
 		{
@@ -849,7 +1491,7 @@ private:
 					tab_threads.emplace_back(
 					    [this, start_it, until_it, i]()
 					    {
-						    std::vector<elem_t> buffer(NBBUFF);
+						    std::vector<key_value_t> buffer(NBBUFF);
 						    this->pthread_processLevel(buffer, start_it, until_it, i);
 					    });
 				}
@@ -861,14 +1503,14 @@ private:
 			}
 			else
 			{
-				std::vector<elem_t> buffer(NBBUFF);
+				std::vector<key_value_t> buffer(NBBUFF);
 				this->pthread_processLevel(buffer, start_it, until_it, i);
 			}
 		};
 
 		if (_writeEachLevel && (i > 1))
 		{
-			data_iterator_level_ptr = std::make_unique<file_binary<elem_t>>(fname_prev);
+			data_iterator_level_ptr = std::make_unique<spill_file_t>(fname_prev);
 			using disklevel_it_type = decltype(data_iterator_level_ptr->begin());
 
 			auto start_it = std::make_shared<disklevel_it_type>(data_iterator_level_ptr->begin());
@@ -889,11 +1531,6 @@ private:
 			launch_workers(start_it, until_it);
 		}
 
-		if (_fastmode && i == _fastModeLevel)
-		{
-			setLevelFastmode.resize(_idxLevelsetLevelFastmode);
-		}
-
 		if (_writeEachLevel)
 		{
 			if (i < static_cast<int>(_nb_levels) - 1 && i > 0)
@@ -904,41 +1541,56 @@ private:
 
 			if (i == static_cast<int>(_nb_levels) - 1)
 			{
+				data_iterator_level_ptr.reset(); // unmap before removing
 				std::remove(fname_prev.c_str());
 			}
 		}
 	}
 
 private:
+	static constexpr uint64_t MIN_FALLBACK_RETRY_KEYS = 64;
+	static constexpr uint32_t MAX_FINGERPRINT_BITS = 16;
+	static constexpr uint64_t PARTITIONED_INSERT_MIN_SLOTS = 1ULL << 22; // smaller levels stay in cache
+	static constexpr size_t PIPELINE_WINDOW = 16;                        // keys in flight per construction thread
+
 	std::vector<level> _levels;
 	uint32_t _nb_levels{0};
 	MultiHasher_t _hasher;
-	bitVector* _tempBitset{nullptr};
+	std::unique_ptr<slot_states> _levelSlots; // level under construction
 
 	double _gamma{2.0};
 	uint64_t _hash_domain{0};
 	uint64_t _nelem{0};
-	std::unordered_map<elem_t, uint64_t, Hasher_t> _final_hash;
+	std::unordered_map<key_view_t, uint64_t, FallbackHasher<key_view_t, Hasher_t>> _final_hash;
+	string_arena _final_arena;
+	packed_array _fingerprints; // empty unless addFingerprints() was called
 	Progress _progressBar;
 	uint32_t _nb_living{0};
 	uint32_t _num_thread{1};
 	uint64_t _hashidx{0};
 	double _proba_collision{0.0};
 	uint64_t _lastbitsetrank{0};
-	uint64_t _idxLevelsetLevelFastmode{0};
+	uint64_t _hash_range{0}; // lookup() results are below this
+	uint32_t _rank_block_bits{static_cast<uint32_t>(bitVector::DEFAULT_RANK_BLOCK_BITS)};
 	uint64_t _cptLevel{0};
 	uint64_t _cptTotalProcessed{0};
 
 	float _percent_elem_loaded_for_fastMode{0.03f};
 	bool _fastmode{false};
-	std::vector<elem_t> setLevelFastmode;
+	key_store<key_value_t> setLevelFastmode;
 
-	std::vector<std::vector<elem_t>> bufferperThread;
+	std::vector<std::vector<key_value_t>> bufferperThread;
 
 	int _fastModeLevel{0};
 	bool _withprogress{true};
 	bool _built{false};
 	bool _writeEachLevel{true};
+	bool _minimal{true};
+	bool _partitionedInsert{false};
+	bool _blockedLevels{false};      // requested; the layout is in use when _blockedLineWords != 0
+	uint32_t _blockedLineWords{0};   // words of level 0 in each line of _blockedLines
+	bitVector _blockedLines;         // levels 0 and 1 in the blocked layout
+	range_reduction _reduction{range_reduction::modulo};
 	FILE* _currlevelFile{nullptr};
 	uint64_t _pid{0};
 
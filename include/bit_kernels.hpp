@@ -0,0 +1,235 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define BOOMPHF_X86_KERNELS 1
+#include <immintrin.h>
+#define BOOMPHF_TARGET(isa) __attribute__((target(isa)))
+#endif
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
+namespace boomphf
+{
+
+/// Hint the CPU to start loading the cache line holding p
+inline void prefetch_read(const void* p) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+	__builtin_prefetch(p, 0, 3);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	_mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#else
+	(void)p;
+#endif
+}
+
+/// Hint the CPU to start loading the cache line holding p, which is about to be written
+inline void prefetch_write(const void* p) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+	__builtin_prefetch(p, 1, 3);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	_mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#else
+	(void)p;
+#endif
+}
+
+////////////////////////////////////////////////////////////////
+// Word-array kernels behind bitVector::build_ranks
+//
+// Portable builds do not enable POPCNT, so __builtin_popcountll becomes a library call. On x86-64 (GCC/Clang) each
+// kernel is also compiled for POPCNT, AVX2 (nibble lookup-table popcount) and AVX-512 VPOPCNTQ, and the best one the
+// CPU supports is picked once at first use.
+////////////////////////////////////////////////////////////////
+
+namespace detail
+{
+
+struct bit_kernels
+{
+	const char* name;
+	/// out[b] = set bits in words before block b (words_per_block, a power of two, words per block); returns the total
+	uint64_t (*block_ranks)(const uint64_t* words, uint64_t nwords, uint64_t words_per_block, uint16_t* out);
+};
+
+// The bodies are written once and instantiated per instruction set: when inlined into a target function,
+// __builtin_popcountll is expanded with that function's instructions.
+
+[[nodiscard]] inline uint64_t popcount_word(uint64_t x) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return static_cast<uint64_t>(__builtin_popcountll(x));
+#else
+	x -= (x >> 1) & 0x5555555555555555ULL;
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return (x * 0x0101010101010101ULL) >> 56;
+#endif
+}
+
+[[nodiscard]] inline uint64_t prefix_popcount_scalar(const uint64_t* words, uint64_t nbits) noexcept
+{
+	const uint64_t nfull = nbits / 64;
+	uint64_t r = 0;
+	for (uint64_t w = 0; w < nfull; ++w)
+	{
+		r += popcount_word(words[w]);
+	}
+	if (nbits % 64 != 0)
+	{
+		r += popcount_word(words[nfull] & ((1ULL << (nbits % 64)) - 1));
+	}
+	return r;
+}
+
+[[nodiscard]] inline uint64_t block_ranks_scalar(const uint64_t* words, uint64_t nwords, uint64_t words_per_block,
+                                                 uint16_t* out) noexcept
+{
+	uint64_t running = 0;
+	for (uint64_t b = 0; b * words_per_block < nwords; ++b)
+	{
+		out[b] = static_cast<uint16_t>(running);
+		const uint64_t end = std::min(nwords, (b + 1) * words_per_block);
+		for (uint64_t w = b * words_per_block; w < end; ++w)
+		{
+			running += popcount_word(words[w]);
+		}
+	}
+	return running;
+}
+
+inline const bit_kernels& generic_bit_kernels()
+{
+	static const bit_kernels k{"generic", block_ranks_scalar};
+	return k;
+}
+
+#ifdef BOOMPHF_X86_KERNELS
+
+// POPCNT: the scalar bodies with the hardware instruction
+
+BOOMPHF_TARGET("popcnt")
+inline uint64_t block_ranks_popcnt(const uint64_t* words, uint64_t nwords, uint64_t words_per_block, uint16_t* out)
+{
+	return block_ranks_scalar(words, nwords, words_per_block, out);
+}
+
+// AVX2: per-word counts from a 4-bit lookup table (vpshufb) summed with vpsadbw
+
+BOOMPHF_TARGET("avx2,popcnt") inline __m256i popcount_epi64_avx2(__m256i v)
+{
+	const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, //
+	                                     0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+	const __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, low_nibbles));
+	const __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibbles));
+	return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+
+/// Blocks shorter than a vector are counted word by word, which POPCNT does faster than splitting vector lanes
+BOOMPHF_TARGET("avx2,popcnt")
+inline uint64_t block_ranks_avx2(const uint64_t* words, uint64_t nwords, uint64_t words_per_block, uint16_t* out)
+{
+	if (words_per_block < 4)
+	{
+		return block_ranks_scalar(words, nwords, words_per_block, out);
+	}
+	uint64_t running = 0;
+	uint64_t w = 0;
+	alignas(32) uint64_t lanes[4];
+	for (; w + 4 <= nwords; w += 4)
+	{
+		if ((w & (words_per_block - 1)) == 0)
+		{
+			*out++ = static_cast<uint16_t>(running);
+		}
+		const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + w));
+		_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), popcount_epi64_avx2(v));
+		running += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+	if (w < nwords)
+	{
+		if ((w & (words_per_block - 1)) == 0)
+		{
+			*out = static_cast<uint16_t>(running);
+		}
+		running += prefix_popcount_scalar(words + w, 64 * (nwords - w));
+	}
+	return running;
+}
+
+// AVX-512: VPOPCNTQ on 8 words at a time, masked loads for the tails. _mm512_reduce_add_epi64 is avoided (as are
+// unmasked extracts): GCC 12 warns about their undefined pass-through operands.
+
+BOOMPHF_TARGET("avx512f,avx512vpopcntdq,popcnt") inline uint64_t reduce_add_avx512(__m512i v)
+{
+	const __m256i quad =
+	    _mm256_add_epi64(_mm512_maskz_extracti64x4_epi64(0xf, v, 0), _mm512_maskz_extracti64x4_epi64(0xf, v, 1));
+	const __m128i pair = _mm_add_epi64(_mm256_castsi256_si128(quad), _mm256_extracti128_si256(quad, 1));
+	return static_cast<uint64_t>(_mm_cvtsi128_si64(pair)) + static_cast<uint64_t>(_mm_extract_epi64(pair, 1));
+}
+
+BOOMPHF_TARGET("avx512f,avx512vpopcntdq,popcnt")
+inline uint64_t block_ranks_avx512(const uint64_t* words, uint64_t nwords, uint64_t words_per_block, uint16_t* out)
+{
+	if (words_per_block < 8)
+	{
+		return block_ranks_scalar(words, nwords, words_per_block, out);
+	}
+	uint64_t running = 0;
+	for (uint64_t w = 0; w < nwords; w += 8)
+	{
+		if ((w & (words_per_block - 1)) == 0)
+		{
+			*out++ = static_cast<uint16_t>(running);
+		}
+		const auto lanes = static_cast<__mmask8>(nwords - w >= 8 ? 0xff : (1u << (nwords - w)) - 1);
+		const __m512i c = _mm512_popcnt_epi64(_mm512_maskz_loadu_epi64(lanes, words + w));
+		running += reduce_add_avx512(c);
+	}
+	return running;
+}
+
+#endif // BOOMPHF_X86_KERNELS
+
+/// Kernels this CPU can run, generic first and best last
+inline std::vector<const bit_kernels*> available_bit_kernels()
+{
+	std::vector<const bit_kernels*> result{&generic_bit_kernels()};
+#ifdef BOOMPHF_X86_KERNELS
+	static const bit_kernels popcnt{"popcnt", block_ranks_popcnt};
+	static const bit_kernels avx2{"avx2", block_ranks_avx2};
+	static const bit_kernels avx512{"avx512", block_ranks_avx512};
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("popcnt"))
+	{
+		result.push_back(&popcnt);
+		if (__builtin_cpu_supports("avx2"))
+		{
+			result.push_back(&avx2);
+		}
+		if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq"))
+		{
+			result.push_back(&avx512);
+		}
+	}
+#endif
+	return result;
+}
+
+/// Kernels used by bitVector, chosen on first use
+inline const bit_kernels& active_bit_kernels()
+{
+	static const bit_kernels& k = *available_bit_kernels().back();
+	return k;
+}
+
+} // namespace detail
+
+} // namespace boomphf
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "bit_kernels.hpp"
 #include "endian_utils.hpp"
 #include <algorithm>
 #include <atomic>
@@ -8,7 +9,10 @@
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <new>
+#include <stdexcept>
 #include <ostream>
+#include <thread>
 #include <vector>
 
 #if defined(_WIN32) || defined(_MSC_VER)
@@ -32,15 +36,17 @@ namespace boomphf
 	return (x * h01) >> 24;
 }
 
-// Prefer compiler builtin when available, otherwise fallback to portable split-32 implementation
+// Prefer compiler builtin when it is an instruction, otherwise fallback to portable bit arithmetic (x86 builds
+// without POPCNT turn the builtin into a library call)
 [[nodiscard]] inline uint64_t popcount_64(uint64_t x) noexcept
 {
-#if defined(__GNUG__) || defined(__clang__)
+#if (defined(__GNUG__) || defined(__clang__)) && (defined(__POPCNT__) || !(defined(__x86_64__) || defined(__i386__)))
 	return static_cast<uint64_t>(__builtin_popcountll(x));
 #else
-	const uint32_t low = x & 0xffffffffu;
-	const uint32_t high = static_cast<uint32_t>((x >> 32ULL) & 0xffffffffu);
-	return popcount_32(low) + popcount_32(high);
+	x -= (x >> 1) & 0x5555555555555555ULL;
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return (x * 0x0101010101010101ULL) >> 56;
 #endif
 }
 
@@ -55,20 +61,28 @@ namespace boomphf
 class bitVector
 {
 public:
+	/// Rank sampling - balance between space and query time (see build_ranks)
+	static constexpr uint64_t DEFAULT_RANK_BLOCK_BITS = 128;
+	static constexpr uint64_t MAX_RANK_BLOCK_BITS = 4096;
+	static constexpr uint64_t SUPERBLOCK_BITS = 1ULL << 16; // relative counts stay below 2^16
+	static constexpr uint64_t CACHE_LINE_BYTES = 64;        // arrays start on a line (except with MSVC)
+
 	bitVector() = default;
 
 	explicit bitVector(uint64_t n) : _size(n)
 	{
 		_nchar = 1ULL + n / 64ULL;
-		_bitArray = new uint64_t[_nchar]();
+		_bitArray = allocate_words(_nchar);
 	}
 
-	~bitVector() { delete[] _bitArray; }
+	~bitVector() { std::free(_bitArray); }
 
 	// Copy constructor
-	bitVector(const bitVector& r) : _size(r._size), _nchar(r._nchar), _ranks(r._ranks)
+	bitVector(const bitVector& r)
+	    : _size(r._size), _nchar(r._nchar), _rank_block_shift(r._rank_block_shift), _super_ranks(r._super_ranks),
+	      _block_ranks(r._block_ranks)
 	{
-		_bitArray = new uint64_t[_nchar];
+		_bitArray = allocate_words(_nchar);
 		for (size_t i = 0; i < _nchar; ++i)
 		{
 			_bitArray[i] = r._bitArray[i];
@@ -82,10 +96,12 @@ public:
 		{
 			_size = r._size;
 			_nchar = r._nchar;
-			_ranks = r._ranks;
+			_rank_block_shift = r._rank_block_shift;
+			_super_ranks = r._super_ranks;
+			_block_ranks = r._block_ranks;
 
-			delete[] _bitArray;
-			_bitArray = new uint64_t[_nchar];
+			std::free(_bitArray);
+			_bitArray = allocate_words(_nchar);
 			for (size_t i = 0; i < _nchar; ++i)
 			{
 				_bitArray[i] = r._bitArray[i];
@@ -99,11 +115,13 @@ public:
 	{
 		if (&r != this)
 		{
-			delete[] _bitArray;
+			std::free(_bitArray);
 
 			_size = r._size;
 			_nchar = r._nchar;
-			_ranks = std::move(r._ranks);
+			_rank_block_shift = r._rank_block_shift;
+			_super_ranks = std::move(r._super_ranks);
+			_block_ranks = std::move(r._block_ranks);
 			_bitArray = r._bitArray;
 			r._bitArray = nullptr;
 			r._size = 0;
@@ -117,14 +135,23 @@ public:
 	void resize(uint64_t newsize)
 	{
 		_nchar = 1ULL + newsize / 64ULL;
-		delete[] _bitArray;
-		_bitArray = new uint64_t[_nchar]();
+		std::free(_bitArray);
+		_bitArray = allocate_words(_nchar);
 		_size = newsize;
 	}
 
 	[[nodiscard]] size_t size() const noexcept { return _size; }
 
-	[[nodiscard]] uint64_t bitSize() const noexcept { return _nchar * 64ULL + _ranks.capacity() * 64ULL; }
+	[[nodiscard]] uint64_t bitSize() const noexcept
+	{
+		return _nchar * 64ULL + _super_ranks.capacity() * 64ULL + _block_ranks.capacity() * 16ULL;
+	}
+
+	/// True when at least one bit is set
+	[[nodiscard]] bool any() const noexcept
+	{
+		return std::any_of(_bitArray, _bitArray + _nchar, [](uint64_t w) { return w != 0; });
+	}
 
 	/// Clear the entire bit array
 	void clear()
@@ -135,20 +162,6 @@ public:
 		}
 	}
 
-	/// Clear collisions in interval (start and size must be multiples of 64)
-	void clearCollisions(uint64_t start, size_t size, bitVector* cc)
-	{
-		assert((start & 63) == 0);
-		assert((size & 63) == 0);
-
-		const uint64_t ids = start / 64ULL;
-		for (uint64_t ii = 0; ii < (size / 64ULL); ++ii)
-		{
-			_bitArray[ids + ii] = _bitArray[ids + ii] & (~(cc->get64(ii)));
-		}
-		cc->clear();
-	}
-
 	/// Clear interval (start and size must be multiples of 64)
 	void clear(uint64_t start, size_t size)
 	{
@@ -176,10 +189,11 @@ public:
 		}
 		std::cout << std::endl;
 
-		std::cout << "rank array : size " << _ranks.size() << std::endl;
-		for (size_t ii = 0; ii < _ranks.size(); ++ii)
+		std::cout << "rank directory : " << _super_ranks.size() << " superblocks, " << _block_ranks.size()
+		          << " blocks of " << rankBlockBits() << " bits" << std::endl;
+		for (size_t ii = 0; ii < _block_ranks.size(); ++ii)
 		{
-			std::cout << ii << " :  " << _ranks[ii] << " , ";
+			std::cout << ii << " :  " << rank_at_block(ii) << " , ";
 		}
 		std::cout << std::endl;
 	}
@@ -213,50 +227,71 @@ public:
 		return (oldval >> (pos & 63)) & 1;
 	}
 
+	/// Atomically read bit (acquire), pairs with atomic_test_and_set from another thread
+	[[nodiscard]] inline uint64_t atomic_get(uint64_t pos) const
+	{
+		const uint64_t* target = _bitArray + (pos >> 6);
+#if defined(_WIN32) || defined(_MSC_VER)
+		// InterlockedCompareExchange64(target, 0, 0) as an atomic load
+		const auto val = static_cast<uint64_t>(InterlockedCompareExchange64(
+		    const_cast<volatile LONG64*>(reinterpret_cast<const volatile LONG64*>(target)), 0, 0));
+#else
+		const uint64_t val = __atomic_load_n(target, __ATOMIC_ACQUIRE);
+#endif
+		return (val >> (pos & 63)) & 1;
+	}
+
 	[[nodiscard]] uint64_t get(uint64_t pos) const { return (*this)[pos]; }
 
 	[[nodiscard]] uint64_t get64(uint64_t cell64) const { return _bitArray[cell64]; }
 
+	void set64(uint64_t cell64, uint64_t word) { _bitArray[cell64] = word; }
+
+	/// Start loading the word holding bit pos
+	void prefetch(uint64_t pos) const noexcept { prefetch_read(_bitArray + (pos >> 6)); }
+
 	/// Set bit at position to 1
 	void set(uint64_t pos) { _bitArray[pos >> 6] |= (1ULL << (pos & 63)); }
 
 	/// Set bit at position to 0
 	void reset(uint64_t pos) { _bitArray[pos >> 6] &= (~(1ULL << (pos & 63))); }
 
-	/// Build rank structure, returns final rank value
-	[[nodiscard]] uint64_t build_ranks(uint64_t offset = 0)
+	/// True when block_bits can be used as rank sampling: a power of two from 64 to MAX_RANK_BLOCK_BITS
+	[[nodiscard]] static constexpr bool valid_rank_block_bits(uint64_t block_bits) noexcept
 	{
-		_ranks.reserve(2 + _size / NB_BITS_PER_RANK_SAMPLE);
+		return block_bits >= 64 && block_bits <= MAX_RANK_BLOCK_BITS && (block_bits & (block_bits - 1)) == 0;
+	}
 
-		uint64_t current_rank = offset;
-		for (size_t ii = 0; ii < _nchar; ++ii)
+	/// Build the rank directory, returns final rank value
+	/// Two levels: an absolute 64-bit count every SUPERBLOCK_BITS bits, and a 16-bit count relative to it every
+	/// block_bits bits. rank() then scans at most block_bits / 64 - 1 words: 128-bit blocks cost about as much memory
+	/// as one 64-bit sample per 512 bits but scan one word instead of up to seven.
+	[[nodiscard]] uint64_t build_ranks(uint64_t offset = 0, uint64_t block_bits = DEFAULT_RANK_BLOCK_BITS,
+	                                   uint32_t nthreads = 1)
+	{
+		if (!valid_rank_block_bits(block_bits))
 		{
-			if ((ii * 64) % NB_BITS_PER_RANK_SAMPLE == 0)
-			{
-				_ranks.push_back(current_rank);
-			}
-			current_rank += popcount_64(_bitArray[ii]);
+			throw std::invalid_argument("rank block size must be a power of two between 64 and 4096 bits");
 		}
-		return current_rank;
+		return rank_pass(offset, set_rank_block_bits(block_bits), nthreads);
 	}
 
 	[[nodiscard]] uint64_t rank(uint64_t pos) const
 	{
+		// At most block_bits / 64 - 1 whole words to count: too few for a call through the dispatched kernels
+		const uint64_t block = pos >> _rank_block_shift;
 		const uint64_t word_idx = pos / 64ULL;
-		const uint64_t word_offset = pos % 64;
-		const uint64_t block = pos / NB_BITS_PER_RANK_SAMPLE;
-
-		uint64_t r = _ranks[block];
-		for (uint64_t w = block * NB_BITS_PER_RANK_SAMPLE / 64; w < word_idx; ++w)
+		uint64_t r = rank_at_block(block);
+		for (uint64_t w = (block << _rank_block_shift) / 64; w < word_idx; ++w)
 		{
 			r += popcount_64(_bitArray[w]);
 		}
-
-		const uint64_t mask = (uint64_t(1) << word_offset) - 1;
-		r += popcount_64(_bitArray[word_idx] & mask);
-		return r;
+		return r + popcount_64(_bitArray[word_idx] & ((uint64_t(1) << (pos % 64)) - 1));
 	}
 
+	[[nodiscard]] bool has_ranks() const noexcept { return !_super_ranks.empty(); }
+	[[nodiscard]] uint64_t rankBlockBits() const noexcept { return 1ULL << _rank_block_shift; }
+
 	void save(std::ostream& os) const
 	{
 		boomphf::write_le(os, _size);
@@ -270,9 +305,13 @@ public:
 		}
 		boomphf::write_le_array(os, temp_array.data(), _nchar);
 
-		const uint64_t sizer = _ranks.size();
+		// The rank directory is rebuilt on load; only its base is stored (as a one-sample rank array)
+		const uint64_t sizer = has_ranks() ? 1 : 0;
 		boomphf::write_le(os, sizer);
-		boomphf::write_le_array(os, _ranks.data(), _ranks.size());
+		if (has_ranks())
+		{
+			boomphf::write_le(os, _super_ranks[0]);
+		}
 	}
 
 	void load(std::istream& is)
@@ -289,10 +328,17 @@ public:
 			_bitArray[i] = temp_array[i];
 		}
 
+		// Older files store a 64-bit sample every 512 bits; any of them is rebuilt from the first sample
 		uint64_t sizer;
 		boomphf::read_le(is, sizer);
-		_ranks.resize(sizer);
-		boomphf::read_le_array(is, _ranks.data(), _ranks.size());
+		std::vector<uint64_t> samples(sizer);
+		boomphf::read_le_array(is, samples.data(), samples.size());
+		_super_ranks.clear();
+		_block_ranks.clear();
+		if (sizer != 0)
+		{
+			[[maybe_unused]] auto total = build_ranks(samples[0], rankBlockBits());
+		}
 	}
 
 private:
@@ -300,9 +346,105 @@ private:
 	uint64_t _size = 0;
 	uint64_t _nchar = 0;
 
-	/// Rank sampling rate - balance between space and query time
-	static constexpr uint64_t NB_BITS_PER_RANK_SAMPLE = 512;
-	std::vector<uint64_t> _ranks;
+	friend class slot_states;
+
+	/// Takes ownership of words, an array of at least 1 + n / 64 words from allocate_words (possibly shrunk)
+	bitVector(uint64_t n, uint64_t* words) noexcept : _bitArray(words), _size(n), _nchar(1ULL + n / 64ULL) {}
+
+	/// Zeroed array of n words starting on a cache line, released with std::free (so that slot_states can shrink its
+	/// buffer into one)
+	[[nodiscard]] static uint64_t* allocate_words(uint64_t n)
+	{
+#if defined(_MSC_VER)
+		auto* words = static_cast<uint64_t*>(std::calloc(n, sizeof(uint64_t)));
+#else
+		const uint64_t bytes = (n * sizeof(uint64_t) + CACHE_LINE_BYTES - 1) / CACHE_LINE_BYTES * CACHE_LINE_BYTES;
+		auto* words = static_cast<uint64_t*>(std::aligned_alloc(CACHE_LINE_BYTES, std::max(bytes, CACHE_LINE_BYTES)));
+		if (words != nullptr)
+		{
+			std::memset(words, 0, n * sizeof(uint64_t));
+		}
+#endif
+		if (words == nullptr)
+		{
+			throw std::bad_alloc();
+		}
+		return words;
+	}
+
+	/// Sets the rank block size, returns it in words
+	uint64_t set_rank_block_bits(uint64_t block_bits) noexcept
+	{
+		_rank_block_shift = 0;
+		while ((1ULL << _rank_block_shift) < block_bits)
+		{
+			++_rank_block_shift;
+		}
+		return block_bits / 64;
+	}
+
+	/// One pass over the words, superblock by superblock, filling the block ranks. Block ranks are relative to their
+	/// superblock, so threads fill them independently; the superblock ranks are then a prefix sum of the counts.
+	uint64_t rank_pass(uint64_t offset, uint64_t words_per_block, uint32_t nthreads)
+	{
+		constexpr uint64_t words_per_super = SUPERBLOCK_BITS / 64;
+		constexpr uint64_t min_supers_per_thread = 32; // below this, starting a thread costs more than it saves
+		const auto& kernels = detail::active_bit_kernels();
+		const uint64_t nsuper = (_nchar + words_per_super - 1) / words_per_super;
+
+		_super_ranks.clear();
+		_block_ranks.clear();
+		_block_ranks.resize((_nchar + words_per_block - 1) / words_per_block);
+
+		std::vector<uint64_t> counts(nsuper);
+		auto pass = [&](uint64_t super_begin, uint64_t super_end)
+		{
+			for (uint64_t sb = super_begin; sb < super_end; ++sb)
+			{
+				const uint64_t first = sb * words_per_super;
+				const uint64_t n = std::min(words_per_super, _nchar - first);
+				counts[sb] = kernels.block_ranks(_bitArray + first, n, words_per_block,
+				                                 _block_ranks.data() + first / words_per_block);
+			}
+		};
+
+		const uint64_t nthr = std::max<uint64_t>(1, std::min<uint64_t>(nthreads, nsuper / min_supers_per_thread));
+		if (nthr > 1)
+		{
+			std::vector<std::thread> threads;
+			threads.reserve(nthr);
+			for (uint64_t t = 0; t < nthr; ++t)
+			{
+				threads.emplace_back(pass, nsuper * t / nthr, nsuper * (t + 1) / nthr);
+			}
+			for (auto& t : threads)
+			{
+				t.join();
+			}
+		}
+		else
+		{
+			pass(0, nsuper);
+		}
+
+		uint64_t current_rank = offset;
+		_super_ranks.reserve(nsuper);
+		for (const uint64_t count : counts)
+		{
+			_super_ranks.push_back(current_rank);
+			current_rank += count;
+		}
+		return current_rank;
+	}
+
+	[[nodiscard]] uint64_t rank_at_block(uint64_t block) const noexcept
+	{
+		return _super_ranks[(block << _rank_block_shift) / SUPERBLOCK_BITS] + _block_ranks[block];
+	}
+
+	uint32_t _rank_block_shift = 7;
+	std::vector<uint64_t> _super_ranks;
+	std::vector<uint16_t> _block_ranks;
 };
 
 } // namespace boomphf
\ No newline at end of file
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "bitvector.hpp"
+#include "endian_utils.hpp"
+#include "packed_array.hpp"
+
+namespace boomphf
+{
+
+/**
+ * Elias-Fano encoding of the set bits of a bitVector, with get and rank answered in compressed form
+ *
+ * Each set position is split into low_bits() low bits, stored in a packed_array, and a high part stored in unary in
+ * an upper bit array (one 1 per position, one 0 closing each high bucket). A sample of every ZERO_SAMPLE-th zero
+ * lets a query jump to its bucket; the bucket is then scanned. For m positions out of u this takes about
+ * m * (2 + log2(u / m)) bits, much less than u + u / 8 bits for the plain array with rank samples when m << u.
+ */
+class elias_fano
+{
+public:
+	elias_fano() = default;
+
+	/// Encode the set bits of bv (universe bv.size()); rank() results are offset by rank_base, as with
+	/// bitVector::build_ranks(rank_base)
+	elias_fano(const bitVector& bv, uint64_t rank_base = 0) : _universe(bv.size()), _rank_base(rank_base)
+	{
+		const uint64_t nwords = (_universe + 63) / 64;
+		for (uint64_t w = 0; w < nwords; ++w)
+		{
+			_count += popcount_64(bv.get64(w));
+		}
+		_low_bits = low_bits_for(_universe, _count);
+		_low = packed_array(_count, _low_bits == 0 ? 1 : _low_bits);
+
+		const uint64_t buckets = (_universe >> _low_bits) + 1;
+		const uint64_t upper_size = _count + buckets;
+		_upper.assign((upper_size + 63) / 64, 0);
+
+		uint64_t i = 0;
+		uint64_t next_zero = 0; // high buckets already closed
+		for (uint64_t w = 0; w < nwords; ++w)
+		{
+			for (uint64_t bits = bv.get64(w); bits != 0; bits &= bits - 1)
+			{
+				const uint64_t pos = w * 64 + static_cast<uint64_t>(trailing_zeros(bits));
+				const uint64_t high = pos >> _low_bits;
+				for (; next_zero < high; ++next_zero)
+				{
+					record_zero(next_zero, next_zero + i);
+				}
+				if (_low_bits != 0)
+				{
+					_low.atomic_set(i, pos & low_mask());
+				}
+				const uint64_t upper_pos = high + i;
+				_upper[upper_pos >> 6] |= 1ULL << (upper_pos & 63);
+				++i;
+			}
+		}
+		for (; next_zero < buckets; ++next_zero)
+		{
+			record_zero(next_zero, next_zero + i);
+		}
+	}
+
+	[[nodiscard]] uint64_t size() const noexcept { return _universe; }
+	[[nodiscard]] uint64_t count() const noexcept { return _count; }
+	[[nodiscard]] uint32_t low_bits() const noexcept { return _low_bits; }
+
+	[[nodiscard]] uint64_t bitSize() const noexcept
+	{
+		return _low.bitSize() + _upper.size() * 64 + _zero_samples.size() * 64;
+	}
+
+	[[nodiscard]] uint64_t get(uint64_t pos) const
+	{
+		uint64_t i, upper_pos;
+		bucket_start(pos >> _low_bits, i, upper_pos);
+		const uint64_t low = pos & low_mask();
+		for (; upper_bit(upper_pos); ++i, ++upper_pos)
+		{
+			const uint64_t l = low_at(i);
+			if (l >= low)
+			{
+				return l == low;
+			}
+		}
+		return 0;
+	}
+
+	/// Number of set positions before pos, plus the rank base
+	[[nodiscard]] uint64_t rank(uint64_t pos) const
+	{
+		uint64_t i, upper_pos;
+		bucket_start(pos >> _low_bits, i, upper_pos);
+		const uint64_t low = pos & low_mask();
+		for (; upper_bit(upper_pos) && low_at(i) < low; ++i, ++upper_pos)
+		{
+		}
+		return _rank_base + i;
+	}
+
+	void save(std::ostream& os) const
+	{
+		write_le(os, _universe);
+		write_le(os, _count);
+		write_le(os, _rank_base);
+		write_le(os, _low_bits);
+		write_le(os, uint32_t(0));
+		_low.save(os);
+		write_le(os, static_cast<uint64_t>(_upper.size()));
+		write_le_array(os, _upper.data(), _upper.size());
+		write_le(os, static_cast<uint64_t>(_zero_samples.size()));
+		write_le_array(os, _zero_samples.data(), _zero_samples.size());
+	}
+
+	void load(std::istream& is)
+	{
+		uint32_t reserved;
+		uint64_t nupper, nsamples;
+		read_le(is, _universe);
+		read_le(is, _count);
+		read_le(is, _rank_base);
+		read_le(is, _low_bits);
+		read_le(is, reserved);
+		if (!is || _count > _universe || _low_bits != low_bits_for(_universe, _count))
+		{
+			throw std::runtime_error("Corrupted elias_fano");
+		}
+		_low.load(is);
+		read_le(is, nupper);
+		const uint64_t buckets = (_universe >> _low_bits) + 1;
+		const uint64_t upper_size = _count + buckets;
+		if (!is || _low.size() != _count || _low.width() != (_low_bits == 0 ? 1 : _low_bits) ||
+		    nupper != (upper_size + 63) / 64)
+		{
+			throw std::runtime_error("Corrupted elias_fano");
+		}
+		_upper.resize(nupper);
+		read_le_array(is, _upper.data(), _upper.size());
+		read_le(is, nsamples);
+		if (!is || nsamples != (buckets + ZERO_SAMPLE - 1) / ZERO_SAMPLE)
+		{
+			throw std::runtime_error("Corrupted elias_fano");
+		}
+		_zero_samples.resize(nsamples);
+		read_le_array(is, _zero_samples.data(), _zero_samples.size());
+
+		// Queries scan the upper bits from the samples: one 1 per position, nothing past upper_size
+		uint64_t ones = 0;
+		for (const uint64_t w : _upper)
+		{
+			ones += popcount_64(w);
+		}
+		const bool bad_tail = upper_size % 64 != 0 && (_upper.back() >> (upper_size % 64)) != 0;
+		if (!is || ones != _count || bad_tail ||
+		    std::any_of(_zero_samples.begin(), _zero_samples.end(), [&](uint64_t s) { return s >= upper_size; }))
+		{
+			throw std::runtime_error("Corrupted elias_fano");
+		}
+	}
+
+private:
+	static constexpr uint64_t ZERO_SAMPLE = 256;
+
+	[[nodiscard]] static uint32_t trailing_zeros(uint64_t x) noexcept
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return static_cast<uint32_t>(__builtin_ctzll(x));
+#else
+		return static_cast<uint32_t>(popcount_64((x & (0 - x)) - 1));
+#endif
+	}
+
+	/// Low part width for count positions out of universe: about log2(universe / count)
+	[[nodiscard]] static uint32_t low_bits_for(uint64_t universe, uint64_t count) noexcept
+	{
+		uint32_t low_bits = 0;
+		while (low_bits < 63 && (universe >> (low_bits + 1)) >= std::max<uint64_t>(count, 1))
+		{
+			++low_bits;
+		}
+		return low_bits;
+	}
+
+	[[nodiscard]] uint64_t low_mask() const noexcept { return (1ULL << _low_bits) - 1; }
+
+	[[nodiscard]] uint64_t low_at(uint64_t i) const noexcept { return _low_bits == 0 ? 0 : _low.get(i); }
+
+	[[nodiscard]] bool upper_bit(uint64_t pos) const noexcept { return (_upper[pos >> 6] >> (pos & 63)) & 1; }
+
+	void record_zero(uint64_t zero, uint64_t upper_pos)
+	{
+		if (zero % ZERO_SAMPLE == 0)
+		{
+			_zero_samples.push_back(upper_pos);
+		}
+	}
+
+	/// First element of high bucket h: its index i and its position in the upper bits
+	void bucket_start(uint64_t h, uint64_t& i, uint64_t& upper_pos) const
+	{
+		const uint64_t buckets = (_universe >> _low_bits) + 1;
+		if (h >= buckets)
+		{
+			i = _count;
+			upper_pos = _count + buckets - 1; // the zero closing the last bucket
+			return;
+		}
+		if (h == 0)
+		{
+			i = 0;
+			upper_pos = 0;
+			return;
+		}
+		// Position of zero number h - 1, found from the closest sample
+		const uint64_t target = h - 1;
+		uint64_t zero = target / ZERO_SAMPLE * ZERO_SAMPLE;
+		uint64_t pos = _zero_samples[target / ZERO_SAMPLE];
+		if (zero != target)
+		{
+			++pos;
+			++zero;
+			uint64_t word = pos >> 6;
+			uint64_t zeros = ~_upper[word] & (~0ULL << (pos & 63));
+			uint64_t in_word = popcount_64(zeros);
+			while (zero + in_word <= target)
+			{
+				zero += in_word;
+				zeros = ~_upper[++word];
+				in_word = popcount_64(zeros);
+			}
+			for (; zero < target; ++zero)
+			{
+				zeros &= zeros - 1;
+			}
+			pos = word * 64 + trailing_zeros(zeros);
+		}
+		upper_pos = pos + 1;
+		i = upper_pos - h;
+	}
+
+	uint64_t _universe{0};
+	uint64_t _count{0};
+	uint64_t _rank_base{0};
+	uint32_t _low_bits{0};
+	packed_array _low;
+	std::vector<uint64_t> _upper;        // high parts in unary
+	std::vector<uint64_t> _zero_samples; // position in _upper of zero number k * ZERO_SAMPLE
+};
+
+} // namespace boomphf
@@ -1,6 +1,8 @@
 #ifndef ENDIAN_UTILS_HPP
 #define ENDIAN_UTILS_HPP
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <iostream>
@@ -103,6 +105,40 @@ template <typename T> inline void read_le(std::istream& is, T& value)
 	value = from_little_endian(le_value);
 }
 
+#if defined(__SIZEOF_INT128__)
+/// 128-bit integers are written as two little-endian 64-bit words, low word first
+inline void write_le(std::ostream& os, const __uint128_t& value)
+{
+	write_le(os, static_cast<uint64_t>(value));
+	write_le(os, static_cast<uint64_t>(value >> 64));
+}
+
+inline void read_le(std::istream& is, __uint128_t& value)
+{
+	uint64_t lo, hi;
+	read_le(is, lo);
+	read_le(is, hi);
+	value = (static_cast<__uint128_t>(hi) << 64) | lo;
+}
+#endif
+
+/// Fixed-size arrays (wide integer keys, digests) are written element by element
+template <typename T, size_t N> inline void write_le(std::ostream& os, const std::array<T, N>& value)
+{
+	for (const auto& v : value)
+	{
+		write_le(os, v);
+	}
+}
+
+template <typename T, size_t N> inline void read_le(std::istream& is, std::array<T, N>& value)
+{
+	for (auto& v : value)
+	{
+		read_le(is, v);
+	}
+}
+
 /// Write array to stream in little-endian format
 template <typename T> inline void write_le_array(std::ostream& os, const T* data, size_t count)
 {
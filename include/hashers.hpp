@@ -0,0 +1,319 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+#include "endian_utils.hpp"
+
+#if (defined(__SSE4_2__) || defined(__AVX__)) && (defined(__x86_64__) || defined(_M_X64))
+#define BOOMPHF_HW_CRC32C 1
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32) && defined(__aarch64__)
+#define BOOMPHF_HW_CRC32C 1
+#include <arm_acle.h>
+#endif
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+namespace boomphf
+{
+
+using hash_set_t = std::array<uint64_t, 10>;
+using hash_pair_t = std::array<uint64_t, 2>;
+
+////////////////////////////////////////////////////////////////
+// Mixing primitives
+////////////////////////////////////////////////////////////////
+
+/// SplitMix64 step, used to derive a fresh seed from the previous one
+[[nodiscard]] inline uint64_t splitmix64(uint64_t x) noexcept
+{
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+/// MurmurHash3 64-bit finalizer (bijective avalanche mix)
+[[nodiscard]] inline constexpr uint64_t fmix64(uint64_t k) noexcept
+{
+	k ^= k >> 33;
+	k *= 0xFF51AFD7ED558CCDULL;
+	k ^= k >> 33;
+	k *= 0xC4CEB9FE1A85EC53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+/// Full 64x64->128 multiply, low half returned in a and high half in b
+inline void wymum(uint64_t& a, uint64_t& b) noexcept
+{
+#if defined(__SIZEOF_INT128__)
+	const __uint128_t r = static_cast<__uint128_t>(a) * b;
+	a = static_cast<uint64_t>(r);
+	b = static_cast<uint64_t>(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	a = _umul128(a, b, &b);
+#else
+	const uint64_t ha = a >> 32, hb = b >> 32, la = static_cast<uint32_t>(a), lb = static_cast<uint32_t>(b);
+	const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	const uint64_t t = rl + (rm0 << 32);
+	uint64_t c = t < rl;
+	const uint64_t lo = t + (rm1 << 32);
+	c += lo < t;
+	a = lo;
+	b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+/// 128-bit product folded to 64 bits (lo ^ hi), the core of wyhash
+[[nodiscard]] inline uint64_t wymix(uint64_t a, uint64_t b) noexcept
+{
+	wymum(a, b);
+	return a ^ b;
+}
+
+namespace detail
+{
+
+constexpr std::array<uint32_t, 256> make_crc32c_table()
+{
+	std::array<uint32_t, 256> table{};
+	for (uint32_t i = 0; i < 256; ++i)
+	{
+		uint32_t crc = i;
+		for (int k = 0; k < 8; ++k)
+		{
+			crc = (crc >> 1) ^ (0x82F63B78U & (0U - (crc & 1U)));
+		}
+		table[i] = crc;
+	}
+	return table;
+}
+
+inline constexpr std::array<uint32_t, 256> crc32c_table = make_crc32c_table();
+
+} // namespace detail
+
+/// CRC32C (Castagnoli) of one 64-bit word, hardware instruction when the target has one
+[[nodiscard]] inline uint32_t crc32c_u64(uint32_t crc, uint64_t v) noexcept
+{
+#if defined(BOOMPHF_HW_CRC32C) && defined(__aarch64__)
+	return __crc32cd(crc, v);
+#elif defined(BOOMPHF_HW_CRC32C)
+	return static_cast<uint32_t>(_mm_crc32_u64(crc, v));
+#else
+	for (int i = 0; i < 8; ++i)
+	{
+		crc = (crc >> 8) ^ detail::crc32c_table[(crc ^ static_cast<uint32_t>(v)) & 0xFFU];
+		v >>= 8;
+	}
+	return crc;
+#endif
+}
+
+////////////////////////////////////////////////////////////////
+// Single-hash functors
+// All take (key, seed) like SingleHashFunctor and work on integer keys up to 64 bits.
+////////////////////////////////////////////////////////////////
+
+template <typename Item> inline constexpr bool is_word_key_v = std::is_integral_v<Item> && sizeof(Item) <= 8;
+
+/// MurmurHash3 finalizer applied to the seeded key: two multiplies, good avalanche
+template <typename Item> class Murmur3Hasher
+{
+	static_assert(is_word_key_v<Item>, "Murmur3Hasher requires an integer key of at most 64 bits");
+
+public:
+	[[nodiscard]] uint64_t operator()(const Item& key, uint64_t seed = 0xAAAAAAAA55555555ULL) const noexcept
+	{
+		return fmix64(static_cast<uint64_t>(key) ^ fmix64(seed));
+	}
+};
+
+/// wyhash-style mixer: two 128-bit multiplies, strongest of the fast hashers
+template <typename Item> class WyHasher
+{
+	static_assert(is_word_key_v<Item>, "WyHasher requires an integer key of at most 64 bits");
+
+	static constexpr uint64_t P0 = 0xA0761D6478BD642FULL;
+	static constexpr uint64_t P1 = 0xE7037ED1A0B428DBULL;
+
+public:
+	[[nodiscard]] uint64_t operator()(const Item& key, uint64_t seed = 0xAAAAAAAA55555555ULL) const noexcept
+	{
+		return wymix(P1 ^ sizeof(Item), wymix(static_cast<uint64_t>(key) ^ P1, seed ^ P0));
+	}
+};
+
+/// CRC32C-based hasher (SSE4.2 / ARMv8 CRC when available, table-driven otherwise)
+/// For a fixed upper half the CRC is a bijection of the lower half, so (upper half, crc) keeps every
+/// key distinct; a final multiply breaks the CRC linearity so that different seeds give independent hashes.
+template <typename Item> class Crc32cHasher
+{
+	static_assert(is_word_key_v<Item>, "Crc32cHasher requires an integer key of at most 64 bits");
+
+public:
+	[[nodiscard]] uint64_t operator()(const Item& key, uint64_t seed = 0xAAAAAAAA55555555ULL) const noexcept
+	{
+		const uint64_t k = static_cast<uint64_t>(key);
+		const uint64_t h = (k & 0xFFFFFFFF00000000ULL) | crc32c_u64(0xFFFFFFFFU, k);
+		return wymix(h ^ seed, 0x9E3779B97F4A7C15ULL);
+	}
+};
+
+////////////////////////////////////////////////////////////////
+// 128-bit integer keys
+////////////////////////////////////////////////////////////////
+
+using uint128_pair_t = std::array<uint64_t, 2>;
+
+/// Low and high 64-bit halves of a 128-bit key
+[[nodiscard]] inline uint128_pair_t key_halves(const uint128_pair_t& key) noexcept { return key; }
+#if defined(__SIZEOF_INT128__)
+[[nodiscard]] inline uint128_pair_t key_halves(__uint128_t key) noexcept
+{
+	return {static_cast<uint64_t>(key), static_cast<uint64_t>(key >> 64)};
+}
+#endif
+
+/// Hasher for 128-bit keys (__uint128_t or std::array<uint64_t, 2> as {low, high}), e.g. k-mers with k > 32 or UUIDs
+/// Folds both halves with a single 128-bit multiply and derives both base hashes from it (a pair hasher).
+template <typename Item> class Hasher128
+{
+	static constexpr uint64_t P0 = 0xA0761D6478BD642FULL;
+	static constexpr uint64_t P1 = 0xE7037ED1A0B428DBULL;
+	static constexpr uint64_t P2 = 0x8EBC6AF09C88C6E3ULL;
+	static constexpr uint64_t P3 = 0x589965CC75374CC3ULL;
+
+public:
+	[[nodiscard]] hash_pair_t operator()(const Item& key, uint64_t seed = 0xAAAAAAAA55555555ULL) const noexcept
+	{
+		const uint128_pair_t halves = key_halves(key);
+		uint64_t a = halves[0] ^ seed ^ P0;
+		uint64_t b = halves[1] ^ ((seed << 32) | (seed >> 32)) ^ P1;
+		wymum(a, b);
+		return {wymix(a ^ P0, b ^ P1), wymix(a ^ P2, b ^ P3)};
+	}
+};
+
+////////////////////////////////////////////////////////////////
+// Byte-oriented hashers
+////////////////////////////////////////////////////////////////
+
+namespace detail
+{
+
+/// Unaligned little-endian loads, so that string hashes are identical on every platform
+[[nodiscard]] inline uint64_t read_u64(const uint8_t* p) noexcept
+{
+	uint64_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return from_little_endian(v);
+}
+
+[[nodiscard]] inline uint64_t read_u32(const uint8_t* p) noexcept
+{
+	uint32_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return from_little_endian(v);
+}
+
+} // namespace detail
+
+/// Fixed-size binary digest (MD5, SHA-1, SHA-256, content hashes...)
+template <size_t N> using digest_t = std::array<uint8_t, N>;
+
+template <typename Item> inline constexpr bool is_digest_key_v = false;
+template <size_t N> inline constexpr bool is_digest_key_v<std::array<uint8_t, N>> = (N >= 8);
+
+/// Hasher for keys that are already uniformly random digests: the two base hashes are read straight from the
+/// first and last 8 bytes, with no mixing. The seed is only XORed in, which is enough to rearrange the
+/// collisions when a build is retried with another seed. Digests shorter than 16 bytes give overlapping words,
+/// so only the first base hash is fully independent there.
+template <typename Item> class DigestHasher
+{
+	static_assert(is_digest_key_v<Item>, "DigestHasher requires a std::array<uint8_t, N> key with N >= 8");
+
+public:
+	[[nodiscard]] hash_pair_t operator()(const Item& key, uint64_t seed = 0xAAAAAAAA55555555ULL) const noexcept
+	{
+		const uint8_t* p = key.data();
+		return {detail::read_u64(p) ^ seed, detail::read_u64(p + key.size() - 8) ^ ((seed << 32) | (seed >> 32))};
+	}
+};
+
+/// wyhash-style hasher for variable-length byte strings (std::string, std::string_view, const char*)
+/// Returns both base hashes from a single pass over the bytes (see is_pair_hasher_v in BooPHF.h).
+class StringHasher
+{
+	static constexpr uint64_t P0 = 0xA0761D6478BD642FULL;
+	static constexpr uint64_t P1 = 0xE7037ED1A0B428DBULL;
+	static constexpr uint64_t P2 = 0x8EBC6AF09C88C6E3ULL;
+	static constexpr uint64_t P3 = 0x589965CC75374CC3ULL;
+
+public:
+	[[nodiscard]] hash_pair_t operator()(std::string_view key, uint64_t seed = 0xAAAAAAAA55555555ULL) const noexcept
+	{
+		const auto* p = reinterpret_cast<const uint8_t*>(key.data());
+		const uint64_t len = key.size();
+		seed ^= wymix(seed ^ P0, P1);
+
+		uint64_t a, b;
+		if (len <= 16)
+		{
+			if (len >= 4)
+			{
+				const size_t mid = (len >> 3) << 2;
+				a = (detail::read_u32(p) << 32) | detail::read_u32(p + mid);
+				b = (detail::read_u32(p + len - 4) << 32) | detail::read_u32(p + len - 4 - mid);
+			}
+			else if (len > 0)
+			{
+				a = (static_cast<uint64_t>(p[0]) << 16) | (static_cast<uint64_t>(p[len >> 1]) << 8) | p[len - 1];
+				b = 0;
+			}
+			else
+			{
+				a = b = 0;
+			}
+		}
+		else
+		{
+			size_t i = len;
+			if (i > 48)
+			{
+				uint64_t see1 = seed, see2 = seed;
+				do
+				{
+					seed = wymix(detail::read_u64(p) ^ P1, detail::read_u64(p + 8) ^ seed);
+					see1 = wymix(detail::read_u64(p + 16) ^ P2, detail::read_u64(p + 24) ^ see1);
+					see2 = wymix(detail::read_u64(p + 32) ^ P3, detail::read_u64(p + 40) ^ see2);
+					p += 48;
+					i -= 48;
+				} while (i > 48);
+				seed ^= see1 ^ see2;
+			}
+			while (i > 16)
+			{
+				seed = wymix(detail::read_u64(p) ^ P1, detail::read_u64(p + 8) ^ seed);
+				p += 16;
+				i -= 16;
+			}
+			a = detail::read_u64(p + i - 16);
+			b = detail::read_u64(p + i - 8);
+		}
+
+		a ^= P1;
+		b ^= seed;
+		wymum(a, b);
+		return {wymix(a ^ P0 ^ len, b ^ P1), wymix(a ^ P2, b ^ P3 ^ len)};
+	}
+};
+
+} // namespace boomphf
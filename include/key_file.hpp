@@ -0,0 +1,400 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "endian_utils.hpp"
+#include "mapped_file.hpp"
+
+namespace boomphf
+{
+
+////////////////////////////////////////////////////////////////
+// Chunked key files
+//
+// Layout (all fields little-endian):
+//   header : magic "BBKEYS\0\1" (u64), version (u32), key bytes (u32), key count (u64), chunk count (u64),
+//            index offset (u64)
+//   chunks : chunk payloads, back to back
+//   index  : per chunk, payload offset (u64), payload bytes (u64), key count (u32), encoding (u32)
+// A chunk is stored raw, or, when its keys are sorted, as the first key followed by the gaps between
+// consecutive keys, all LEB128 varints.
+////////////////////////////////////////////////////////////////
+
+inline constexpr uint64_t KEY_FILE_MAGIC = 0x01005359454B4242ULL; // "BBKEYS\0\1" in little-endian byte order
+inline constexpr uint32_t KEY_FILE_VERSION = 1;
+
+enum class chunk_encoding : uint32_t
+{
+	raw = 0,
+	delta_varint = 1,
+};
+
+namespace detail
+{
+
+inline constexpr size_t KEY_FILE_HEADER_BYTES = 8 + 4 + 4 + 8 + 8 + 8;
+inline constexpr size_t KEY_FILE_INDEX_ENTRY_BYTES = 8 + 8 + 4 + 4;
+
+inline void put_varint(std::vector<char>& out, uint64_t v)
+{
+	while (v >= 0x80)
+	{
+		out.push_back(static_cast<char>((v & 0x7F) | 0x80));
+		v >>= 7;
+	}
+	out.push_back(static_cast<char>(v));
+}
+
+[[nodiscard]] inline const uint8_t* get_varint(const uint8_t* p, const uint8_t* end, uint64_t& v)
+{
+	v = 0;
+	for (unsigned shift = 0; p < end && shift < 64; shift += 7)
+	{
+		const uint8_t byte = *p++;
+		v |= static_cast<uint64_t>(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+		{
+			return p;
+		}
+	}
+	throw std::runtime_error("Corrupted varint in key file");
+}
+
+template <typename T> [[nodiscard]] inline T load_le(const char* p) noexcept
+{
+	T v;
+	std::memcpy(&v, p, sizeof(T));
+	return from_little_endian(v);
+}
+
+} // namespace detail
+
+/// Writes keys into a chunked key file; chunks whose keys are sorted are delta-varint compressed when compress is set
+template <typename Key = uint64_t> class key_file_writer
+{
+	static_assert(std::is_integral_v<Key> && std::is_unsigned_v<Key>, "key files hold unsigned integer keys");
+
+public:
+	explicit key_file_writer(const std::string& filename, bool compress = true, size_t chunk_keys = 1 << 16)
+	    : _os(filename, std::ios::binary), _compress(compress), _chunk_keys(std::max<size_t>(chunk_keys, 1))
+	{
+		if (!_os)
+		{
+			throw std::invalid_argument("Error opening " + filename);
+		}
+		if (_chunk_keys > UINT32_MAX)
+		{
+			throw std::invalid_argument("chunk_keys must fit in 32 bits");
+		}
+		write_header(); // rewritten with the final counts by close()
+		_chunk.reserve(_chunk_keys);
+	}
+
+	key_file_writer(const key_file_writer&) = delete;
+	key_file_writer& operator=(const key_file_writer&) = delete;
+
+	~key_file_writer()
+	{
+		try
+		{
+			close();
+		}
+		catch (...)
+		{
+		}
+	}
+
+	void add(Key key)
+	{
+		_chunk.push_back(key);
+		if (_chunk.size() == _chunk_keys)
+		{
+			flush_chunk();
+		}
+	}
+
+	template <typename Range> void add_all(const Range& keys)
+	{
+		for (const auto& key : keys)
+		{
+			add(static_cast<Key>(key));
+		}
+	}
+
+	/// Write the pending chunk, the index and the final header
+	void close()
+	{
+		if (_closed)
+		{
+			return;
+		}
+		_closed = true;
+		flush_chunk();
+
+		_index_offset = static_cast<uint64_t>(_os.tellp());
+		for (const auto& entry : _index)
+		{
+			write_le(_os, entry.offset);
+			write_le(_os, entry.bytes);
+			write_le(_os, entry.count);
+			write_le(_os, static_cast<uint32_t>(entry.encoding));
+		}
+		_os.seekp(0);
+		write_header();
+		_os.close();
+		if (_os.fail())
+		{
+			throw std::runtime_error("Error writing key file");
+		}
+	}
+
+private:
+	struct index_entry
+	{
+		uint64_t offset;
+		uint64_t bytes;
+		uint32_t count;
+		chunk_encoding encoding;
+	};
+
+	void write_header()
+	{
+		write_le(_os, KEY_FILE_MAGIC);
+		write_le(_os, KEY_FILE_VERSION);
+		write_le(_os, static_cast<uint32_t>(sizeof(Key)));
+		write_le(_os, _nb_keys);
+		write_le(_os, static_cast<uint64_t>(_index.size()));
+		write_le(_os, _index_offset);
+	}
+
+	void flush_chunk()
+	{
+		if (_chunk.empty())
+		{
+			return;
+		}
+
+		index_entry entry{static_cast<uint64_t>(_os.tellp()), 0, static_cast<uint32_t>(_chunk.size()),
+		                  chunk_encoding::raw};
+		if (_compress && std::is_sorted(_chunk.begin(), _chunk.end()))
+		{
+			_bytes.clear();
+			detail::put_varint(_bytes, _chunk[0]);
+			for (size_t ii = 1; ii < _chunk.size(); ++ii)
+			{
+				detail::put_varint(_bytes, static_cast<uint64_t>(_chunk[ii] - _chunk[ii - 1]));
+			}
+			_os.write(_bytes.data(), static_cast<std::streamsize>(_bytes.size()));
+			entry.bytes = _bytes.size();
+			entry.encoding = chunk_encoding::delta_varint;
+		}
+		else
+		{
+			write_le_array(_os, _chunk.data(), _chunk.size());
+			entry.bytes = _chunk.size() * sizeof(Key);
+		}
+
+		_index.push_back(entry);
+		_nb_keys += _chunk.size();
+		_chunk.clear();
+	}
+
+	std::ofstream _os;
+	bool _compress;
+	size_t _chunk_keys;
+	std::vector<Key> _chunk;
+	std::vector<char> _bytes;
+	std::vector<index_entry> _index;
+	uint64_t _nb_keys{0};
+	uint64_t _index_offset{0};
+	bool _closed{false};
+};
+
+template <typename Key> class key_file;
+
+/// Sequential iterator over a key_file, decoding one chunk at a time
+/// mphf construction threads do not dereference it: they claim whole chunks with claim_chunk() and decode them
+/// on their own (see is_chunked_iterator_v).
+template <typename Key> class key_file_iterator
+{
+public:
+	using iterator_category = std::input_iterator_tag;
+	using value_type = Key;
+	using difference_type = std::ptrdiff_t;
+	using pointer = const Key*;
+	using reference = const Key&;
+
+	key_file_iterator() = default;
+
+	key_file_iterator(const key_file<Key>* file, uint64_t chunk) : _file(file), _chunk(chunk) {}
+
+	reference operator*() const
+	{
+		if (!_loaded)
+		{
+			_file->decode_chunk(_chunk, _keys);
+			_loaded = true;
+		}
+		return _keys[_pos];
+	}
+
+	key_file_iterator& operator++()
+	{
+		if (!_loaded)
+		{
+			_file->decode_chunk(_chunk, _keys);
+		}
+		if (++_pos >= _keys.size())
+		{
+			++_chunk;
+			_pos = 0;
+			_loaded = false;
+		}
+		else
+		{
+			_loaded = true;
+		}
+		return *this;
+	}
+
+	/// Return the chunk at the current position and move to the start of the next one
+	[[nodiscard]] uint64_t claim_chunk()
+	{
+		_pos = 0;
+		_loaded = false;
+		return _chunk++;
+	}
+
+	[[nodiscard]] const key_file<Key>* source() const noexcept { return _file; }
+
+	friend bool operator==(const key_file_iterator& lhs, const key_file_iterator& rhs)
+	{
+		return lhs._chunk == rhs._chunk && lhs._pos == rhs._pos;
+	}
+
+	friend bool operator!=(const key_file_iterator& lhs, const key_file_iterator& rhs) { return !(lhs == rhs); }
+
+private:
+	const key_file<Key>* _file{nullptr};
+	uint64_t _chunk{0};
+	size_t _pos{0};
+	mutable std::vector<Key> _keys;
+	mutable bool _loaded{false};
+};
+
+/// Memory-mapped reader for chunked key files, usable directly as mphf input
+template <typename Key = uint64_t> class key_file
+{
+	static_assert(std::is_integral_v<Key> && std::is_unsigned_v<Key>, "key files hold unsigned integer keys");
+
+public:
+	explicit key_file(const std::string& filename) : _file(filename)
+	{
+		if (_file.size() < detail::KEY_FILE_HEADER_BYTES ||
+		    detail::load_le<uint64_t>(_file.data()) != KEY_FILE_MAGIC)
+		{
+			throw std::invalid_argument(filename + " is not a key file");
+		}
+		const char* p = _file.data() + 8;
+		if (detail::load_le<uint32_t>(p) != KEY_FILE_VERSION)
+		{
+			throw std::runtime_error("Unsupported key file version in " + filename);
+		}
+		if (detail::load_le<uint32_t>(p + 4) != sizeof(Key))
+		{
+			throw std::invalid_argument(filename + " holds keys of another size");
+		}
+		_nb_keys = detail::load_le<uint64_t>(p + 8);
+		_nb_chunks = detail::load_le<uint64_t>(p + 16);
+		_index_offset = detail::load_le<uint64_t>(p + 24);
+		if (_index_offset > _file.size() ||
+		    (_file.size() - _index_offset) / detail::KEY_FILE_INDEX_ENTRY_BYTES < _nb_chunks)
+		{
+			throw std::runtime_error("Truncated key file " + filename);
+		}
+	}
+
+	[[nodiscard]] key_file_iterator<Key> begin() const { return key_file_iterator<Key>(this, 0); }
+	[[nodiscard]] key_file_iterator<Key> end() const { return key_file_iterator<Key>(this, _nb_chunks); }
+
+	[[nodiscard]] uint64_t size() const noexcept { return _nb_keys; }
+	[[nodiscard]] uint64_t nbChunks() const noexcept { return _nb_chunks; }
+
+	/// Decode chunk c into out (resized to the chunk's key count); safe to call from several threads at once
+	void decode_chunk(uint64_t c, std::vector<Key>& out) const
+	{
+		const char* entry = _file.data() + _index_offset + c * detail::KEY_FILE_INDEX_ENTRY_BYTES;
+		const uint64_t offset = detail::load_le<uint64_t>(entry);
+		const uint64_t bytes = detail::load_le<uint64_t>(entry + 8);
+		const uint32_t count = detail::load_le<uint32_t>(entry + 16);
+		const auto encoding = static_cast<chunk_encoding>(detail::load_le<uint32_t>(entry + 20));
+		if (offset > _index_offset || bytes > _index_offset - offset)
+		{
+			throw std::runtime_error("Corrupted key file index");
+		}
+
+		out.resize(count);
+		const char* data = _file.data() + offset;
+		if (encoding == chunk_encoding::raw)
+		{
+			if (bytes != static_cast<uint64_t>(count) * sizeof(Key))
+			{
+				throw std::runtime_error("Corrupted key file index");
+			}
+			for (uint32_t ii = 0; ii < count; ++ii)
+			{
+				out[ii] = detail::load_le<Key>(data + ii * sizeof(Key));
+			}
+		}
+		else if (encoding == chunk_encoding::delta_varint)
+		{
+			const auto* p = reinterpret_cast<const uint8_t*>(data);
+			const uint8_t* end = p + bytes;
+			uint64_t key = 0;
+			for (uint32_t ii = 0; ii < count; ++ii)
+			{
+				uint64_t delta;
+				p = detail::get_varint(p, end, delta);
+				key += delta;
+				out[ii] = static_cast<Key>(key);
+			}
+		}
+		else
+		{
+			throw std::runtime_error("Unknown key file chunk encoding");
+		}
+	}
+
+private:
+	mapped_file _file;
+	uint64_t _nb_keys{0};
+	uint64_t _nb_chunks{0};
+	uint64_t _index_offset{0};
+};
+
+/// Write keys to filename as a chunked key file
+template <typename Key = uint64_t, typename Range>
+void write_key_file(const std::string& filename, const Range& keys, bool compress = true, size_t chunk_keys = 1 << 16)
+{
+	key_file_writer<Key> writer(filename, compress, chunk_keys);
+	writer.add_all(keys);
+	writer.close();
+}
+
+/// True for iterators whose chunks can be claimed and decoded independently by construction threads
+template <typename Iterator, typename = void> inline constexpr bool is_chunked_iterator_v = false;
+template <typename Iterator>
+inline constexpr bool is_chunked_iterator_v<Iterator, std::void_t<decltype(std::declval<Iterator&>().claim_chunk()),
+                                                                    decltype(std::declval<Iterator&>().source())>> =
+    true;
+
+} // namespace boomphf
@@ -0,0 +1,340 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "endian_utils.hpp"
+#include "platform_time.h"
+
+namespace boomphf
+{
+
+////////////////////////////////////////////////////////////////
+// Key traits
+////////////////////////////////////////////////////////////////
+
+/// Customization point describing how mphf stores, hashes and serializes a key type
+///   value_type      : owning copy kept in construction buffers, spill files and fast-mode storage
+///   view_type       : type handed to the hasher and accepted by mphf::lookup
+///   variable_length : keys are spilled and serialized with a length prefix
+template <typename T> struct key_traits
+{
+	using value_type = T;
+	using view_type = T;
+	static constexpr bool variable_length = false;
+
+	static void write(std::ostream& os, const T& key) { write_le(os, key); }
+	static void read(std::istream& is, T& key) { read_le(is, key); }
+};
+
+/// Byte strings are hashed and looked up as std::string_view, so lookups never allocate
+struct string_key_traits
+{
+	using value_type = std::string;
+	using view_type = std::string_view;
+	static constexpr bool variable_length = true;
+	/// Longest key read back: a corrupted length fails instead of allocating up to 2^64 bytes
+	static constexpr uint64_t MAX_KEY_BYTES = 1ULL << 30;
+
+	static void write(std::ostream& os, std::string_view key)
+	{
+		write_le(os, static_cast<uint64_t>(key.size()));
+		os.write(key.data(), static_cast<std::streamsize>(key.size()));
+	}
+
+	static void read(std::istream& is, std::string& key)
+	{
+		uint64_t len = 0;
+		read_le(is, len);
+		if (!is || len > MAX_KEY_BYTES)
+		{
+			throw std::runtime_error("Corrupted string key");
+		}
+		key.resize(static_cast<size_t>(len));
+		if (!is.read(key.data(), static_cast<std::streamsize>(len)))
+		{
+			throw std::runtime_error("Corrupted string key");
+		}
+	}
+};
+
+template <> struct key_traits<std::string> : string_key_traits
+{
+};
+
+template <> struct key_traits<std::string_view> : string_key_traits
+{
+};
+
+/// Byte digests have no endianness: written and read as one block
+template <size_t N> struct key_traits<std::array<uint8_t, N>>
+{
+	using value_type = std::array<uint8_t, N>;
+	using view_type = value_type;
+	static constexpr bool variable_length = false;
+
+	static void write(std::ostream& os, const value_type& key)
+	{
+		os.write(reinterpret_cast<const char*>(key.data()), static_cast<std::streamsize>(N));
+	}
+	static void read(std::istream& is, value_type& key)
+	{
+		is.read(reinterpret_cast<char*>(key.data()), static_cast<std::streamsize>(N));
+	}
+};
+
+////////////////////////////////////////////////////////////////
+// Key storage
+////////////////////////////////////////////////////////////////
+
+/// Append-only storage for string bytes; views returned by intern() stay valid until clear()
+class string_arena
+{
+public:
+	[[nodiscard]] std::string_view intern(std::string_view s)
+	{
+		if (s.empty())
+		{
+			return {};
+		}
+		if (_chunks.empty() || s.size() > _chunk_capacity - _used)
+		{
+			_chunk_capacity = std::max(CHUNK_SIZE, s.size());
+			_chunks.emplace_back(new char[_chunk_capacity]);
+			_used = 0;
+		}
+		char* dst = _chunks.back().get() + _used;
+		std::memcpy(dst, s.data(), s.size());
+		_used += s.size();
+		_bytes += s.size();
+		return {dst, s.size()};
+	}
+
+	void clear()
+	{
+		_chunks.clear();
+		_used = 0;
+		_chunk_capacity = 0;
+		_bytes = 0;
+	}
+
+	/// Total number of string bytes stored
+	[[nodiscard]] size_t bytes() const noexcept { return _bytes; }
+
+private:
+	static constexpr size_t CHUNK_SIZE = 1 << 16;
+
+	std::vector<std::unique_ptr<char[]>> _chunks;
+	size_t _used{0};
+	size_t _chunk_capacity{0};
+	size_t _bytes{0};
+};
+
+/// Fixed-capacity storage for the keys that survive to the fast-mode level
+template <typename T> class key_store
+{
+public:
+	using const_iterator = typename std::vector<T>::const_iterator;
+
+	void reset(size_t capacity)
+	{
+		_keys.resize(capacity);
+		_count = 0;
+	}
+
+	/// Returns false when the store is full
+	[[nodiscard]] bool push(const T& key)
+	{
+		if (_count >= _keys.size())
+		{
+			return false;
+		}
+		_keys[_count++] = key;
+		return true;
+	}
+
+	void release()
+	{
+		std::vector<T>().swap(_keys);
+		_count = 0;
+	}
+
+	[[nodiscard]] size_t size() const noexcept { return _count; }
+	[[nodiscard]] const_iterator begin() const { return _keys.begin(); }
+	[[nodiscard]] const_iterator end() const { return _keys.begin() + static_cast<std::ptrdiff_t>(_count); }
+
+private:
+	std::vector<T> _keys;
+	size_t _count{0};
+};
+
+/// String survivors are packed into an arena instead of one heap allocation per key
+template <> class key_store<std::string>
+{
+public:
+	using const_iterator = std::vector<std::string_view>::const_iterator;
+
+	void reset(size_t capacity)
+	{
+		_arena.clear();
+		_keys.clear();
+		_keys.reserve(capacity);
+		_capacity = capacity;
+	}
+
+	[[nodiscard]] bool push(std::string_view key)
+	{
+		if (_keys.size() >= _capacity)
+		{
+			return false;
+		}
+		_keys.push_back(_arena.intern(key));
+		return true;
+	}
+
+	void release()
+	{
+		_arena.clear();
+		std::vector<std::string_view>().swap(_keys);
+		_capacity = 0;
+	}
+
+	[[nodiscard]] size_t size() const noexcept { return _keys.size(); }
+	[[nodiscard]] const_iterator begin() const { return _keys.begin(); }
+	[[nodiscard]] const_iterator end() const { return _keys.end(); }
+
+private:
+	string_arena _arena;
+	std::vector<std::string_view> _keys;
+	size_t _capacity{0};
+};
+
+////////////////////////////////////////////////////////////////
+// Spill files (writeEachLevel)
+////////////////////////////////////////////////////////////////
+
+/// Append count keys to a temporary level file; variable-length keys are written as (native uint64_t length, bytes)
+template <typename T> inline void write_keys_with_file_lock(FILE* file, const std::vector<T>& buffer, size_t count)
+{
+	if constexpr (key_traits<T>::variable_length)
+	{
+		std::vector<char> bytes;
+		for (size_t ii = 0; ii < count; ++ii)
+		{
+			const uint64_t len = buffer[ii].size();
+			const size_t pos = bytes.size();
+			bytes.resize(pos + sizeof(len) + buffer[ii].size());
+			std::memcpy(bytes.data() + pos, &len, sizeof(len));
+			std::memcpy(bytes.data() + pos + sizeof(len), buffer[ii].data(), buffer[ii].size());
+		}
+		write_with_file_lock(file, bytes, bytes.size());
+	}
+	else
+	{
+		write_with_file_lock(file, buffer, count);
+	}
+}
+
+/// Iterator over a length-prefixed string spill file
+class bfile_string_iterator
+{
+public:
+	using iterator_category = std::input_iterator_tag;
+	using value_type = std::string;
+	using difference_type = std::ptrdiff_t;
+	using pointer = const std::string*;
+	using reference = const std::string&;
+
+	bfile_string_iterator() = default;
+
+	explicit bfile_string_iterator(FILE* is) : _is(is)
+	{
+		std::fseek(_is, 0, SEEK_SET);
+		advance();
+	}
+
+	reference operator*() const { return _elem; }
+
+	bfile_string_iterator& operator++()
+	{
+		advance();
+		return *this;
+	}
+
+	friend bool operator==(const bfile_string_iterator& lhs, const bfile_string_iterator& rhs)
+	{
+		if (!lhs._is || !rhs._is)
+		{
+			return !lhs._is && !rhs._is;
+		}
+		assert(lhs._is == rhs._is);
+		return rhs._pos == lhs._pos;
+	}
+
+	friend bool operator!=(const bfile_string_iterator& lhs, const bfile_string_iterator& rhs)
+	{
+		return !(lhs == rhs);
+	}
+
+private:
+	void advance()
+	{
+		++_pos;
+
+		uint64_t len;
+		if (std::fread(&len, sizeof(len), 1, _is) != 1)
+		{
+			_is = nullptr;
+			_pos = 0;
+			return;
+		}
+		_elem.resize(static_cast<size_t>(len));
+		if (len > 0 && std::fread(_elem.data(), 1, static_cast<size_t>(len), _is) != len)
+		{
+			throw std::runtime_error("Truncated string spill file");
+		}
+	}
+
+	std::string _elem;
+	FILE* _is{nullptr};
+	uint64_t _pos{0};
+};
+
+/// Length-prefixed string spill file reader with iterator interface
+class file_strings
+{
+public:
+	file_strings(const file_strings&) = delete;
+	file_strings& operator=(const file_strings&) = delete;
+
+	explicit file_strings(const std::string& filename)
+	{
+		_is = std::fopen(filename.c_str(), "rb");
+		if (!_is)
+		{
+			throw std::invalid_argument("Error opening " + filename);
+		}
+	}
+
+	~file_strings() { std::fclose(_is); }
+
+	[[nodiscard]] bfile_string_iterator begin() const { return bfile_string_iterator(_is); }
+
+	[[nodiscard]] bfile_string_iterator end() const { return bfile_string_iterator(); }
+
+private:
+	FILE* _is;
+};
+
+} // namespace boomphf
@@ -0,0 +1,398 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace boomphf
+{
+
+////////////////////////////////////////////////////////////////
+// K-mer key source for FASTA / FASTQ files
+////////////////////////////////////////////////////////////////
+
+/// 2-bit code of a nucleotide (A=0, C=1, G=2, T=3), or 4 for anything else (N, IUPAC codes, separators)
+[[nodiscard]] inline uint8_t nucleotide_code(char c) noexcept
+{
+	switch (c)
+	{
+	case 'A':
+	case 'a':
+		return 0;
+	case 'C':
+	case 'c':
+		return 1;
+	case 'G':
+	case 'g':
+		return 2;
+	case 'T':
+	case 't':
+		return 3;
+	default:
+		return 4;
+	}
+}
+
+/// Largest k supported by a k-mer word type (2 bits per base)
+template <typename kmer_t> inline constexpr unsigned max_kmer_size_v = static_cast<unsigned>(sizeof(kmer_t) * 4);
+
+/// Append the canonical k-mers (min of forward and reverse complement) of every ACGT run in seq to out
+/// A rolling 2-bit encoding is used: each base costs a shift/or on both strands.
+template <typename kmer_t> void encode_canonical_kmers(std::string_view seq, unsigned k, std::vector<kmer_t>& out)
+{
+	static_assert(std::is_unsigned_v<kmer_t> || sizeof(kmer_t) == 16, "k-mers are stored in unsigned integer words");
+
+	const kmer_t mask = (k == max_kmer_size_v<kmer_t>) ? ~kmer_t(0) : ((kmer_t(1) << (2 * k)) - 1);
+	const unsigned rc_shift = 2 * (k - 1);
+
+	kmer_t fwd = 0;
+	kmer_t rev = 0;
+	unsigned valid = 0;
+	for (const char c : seq)
+	{
+		const uint8_t code = nucleotide_code(c);
+		if (code > 3)
+		{
+			valid = 0;
+			continue;
+		}
+		fwd = ((fwd << 2) | code) & mask;
+		rev = (rev >> 2) | (kmer_t(3 - code) << rc_shift);
+		if (++valid >= k)
+		{
+			out.push_back(fwd < rev ? fwd : rev);
+		}
+	}
+}
+
+/// Number of k-mers encode_canonical_kmers() would produce for seq
+[[nodiscard]] inline uint64_t count_kmers(std::string_view seq, unsigned k) noexcept
+{
+	uint64_t count = 0;
+	unsigned valid = 0;
+	for (const char c : seq)
+	{
+		if (nucleotide_code(c) > 3)
+		{
+			valid = 0;
+		}
+		else if (++valid >= k)
+		{
+			++count;
+		}
+	}
+	return count;
+}
+
+/// Splits a FASTA or FASTQ file into chunks of bases that can be encoded independently
+/// Records are separated by '\n' inside a chunk; a record cut at a chunk boundary is continued in the next chunk
+/// with its last k-1 bases repeated, so no k-mer is lost or produced twice. The format is detected from the
+/// first record ('>' FASTA, '@' FASTQ with 4-line records).
+class sequence_chunker
+{
+public:
+	sequence_chunker(const std::string& filename, unsigned k, size_t chunk_bases)
+	    : _k(k), _chunk_bases(chunk_bases), _buffer(BUFFER_SIZE)
+	{
+		_is = std::fopen(filename.c_str(), "rb");
+		if (!_is)
+		{
+			throw std::invalid_argument("Error opening " + filename);
+		}
+	}
+
+	sequence_chunker(const sequence_chunker&) = delete;
+	sequence_chunker& operator=(const sequence_chunker&) = delete;
+
+	~sequence_chunker() { std::fclose(_is); }
+
+	/// Fill chunk with the next bases; returns false at end of file
+	[[nodiscard]] bool next(std::string& chunk)
+	{
+		chunk.swap(_carry);
+		_carry.clear();
+
+		while (chunk.size() < _chunk_bases)
+		{
+			if (!read_line())
+			{
+				return !chunk.empty();
+			}
+			if (_line.empty())
+			{
+				continue;
+			}
+
+			if (_fastq < 0)
+			{
+				_fastq = (_line[0] == '@') ? 1 : 0;
+				if (_line[0] != '@' && _line[0] != '>')
+				{
+					throw std::runtime_error("Input is neither FASTA nor FASTQ");
+				}
+			}
+
+			if (_fastq == 1)
+			{
+				// Line 1 of every 4 holds the sequence; reads are short, so they are never split
+				if (_fastq_line++ % 4 == 1)
+				{
+					chunk.append(_line);
+					chunk.push_back('\n');
+				}
+			}
+			else if (_line[0] == '>')
+			{
+				if (!chunk.empty() && chunk.back() != '\n')
+				{
+					chunk.push_back('\n');
+				}
+			}
+			else
+			{
+				chunk.append(_line);
+			}
+		}
+
+		// FASTA record continues in the next chunk: repeat its last k-1 bases there
+		if (_fastq == 0 && chunk.back() != '\n')
+		{
+			const size_t overlap = std::min<size_t>(_k - 1, chunk.size());
+			_carry.assign(chunk, chunk.size() - overlap, overlap);
+		}
+		return true;
+	}
+
+private:
+	static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+	/// Read the next line (without the line terminator) into _line
+	[[nodiscard]] bool read_line()
+	{
+		_line.clear();
+		for (;;)
+		{
+			if (_pos == _end)
+			{
+				_end = std::fread(_buffer.data(), 1, _buffer.size(), _is);
+				_pos = 0;
+				if (_end == 0)
+				{
+					return !_line.empty();
+				}
+			}
+			const char* start = _buffer.data() + _pos;
+			const auto* nl = static_cast<const char*>(std::memchr(start, '\n', _end - _pos));
+			if (nl)
+			{
+				_line.append(start, nl);
+				_pos += static_cast<size_t>(nl - start) + 1;
+				if (!_line.empty() && _line.back() == '\r')
+				{
+					_line.pop_back();
+				}
+				return true;
+			}
+			_line.append(start, _end - _pos);
+			_pos = _end;
+		}
+	}
+
+	FILE* _is;
+	unsigned _k;
+	size_t _chunk_bases;
+	std::vector<char> _buffer;
+	size_t _pos{0};
+	size_t _end{0};
+	std::string _line;
+	std::string _carry;
+	int _fastq{-1};
+	uint64_t _fastq_line{0};
+};
+
+/// Input iterator over the canonical k-mers of a FASTA/FASTQ file
+/// Chunks are read sequentially and encoded in parallel, num_thread chunks at a time; k-mers come out in file order.
+/// Copies share the same underlying stream, like other single-pass input iterators.
+template <typename kmer_t> class kmer_iterator
+{
+public:
+	using iterator_category = std::input_iterator_tag;
+	using value_type = kmer_t;
+	using difference_type = std::ptrdiff_t;
+	using pointer = const kmer_t*;
+	using reference = const kmer_t&;
+
+	kmer_iterator() = default;
+
+	kmer_iterator(const std::string& filename, unsigned k, unsigned num_thread, size_t chunk_bases)
+	    : _state(std::make_shared<state>(filename, k, num_thread, chunk_bases))
+	{
+		refill();
+	}
+
+	reference operator*() const { return _state->batches[_state->batch][_state->pos]; }
+
+	kmer_iterator& operator++()
+	{
+		if (++_state->pos == _state->batches[_state->batch].size())
+		{
+			_state->pos = 0;
+			++_state->batch;
+			refill();
+		}
+		return *this;
+	}
+
+	friend bool operator==(const kmer_iterator& lhs, const kmer_iterator& rhs)
+	{
+		const bool lhs_end = !lhs._state || lhs._state->done;
+		const bool rhs_end = !rhs._state || rhs._state->done;
+		if (lhs_end || rhs_end)
+		{
+			return lhs_end && rhs_end;
+		}
+		return lhs._state == rhs._state;
+	}
+
+	friend bool operator!=(const kmer_iterator& lhs, const kmer_iterator& rhs) { return !(lhs == rhs); }
+
+private:
+	struct state
+	{
+		state(const std::string& filename, unsigned k_, unsigned num_thread_, size_t chunk_bases)
+		    : chunker(filename, k_, chunk_bases), k(k_), num_thread(num_thread_ ? num_thread_ : 1),
+		      chunks(num_thread), batches(num_thread)
+		{
+		}
+
+		sequence_chunker chunker;
+		unsigned k;
+		unsigned num_thread;
+		std::vector<std::string> chunks;
+		std::vector<std::vector<kmer_t>> batches;
+		size_t batch{0};
+		size_t pos{0};
+		bool done{false};
+	};
+
+	/// Skip to the next non-empty batch, reading and encoding a new round of chunks when needed
+	void refill()
+	{
+		state& st = *_state;
+		for (;;)
+		{
+			while (st.batch < st.batches.size())
+			{
+				if (!st.batches[st.batch].empty())
+				{
+					return;
+				}
+				++st.batch;
+			}
+
+			size_t nchunks = 0;
+			while (nchunks < st.num_thread && st.chunker.next(st.chunks[nchunks]))
+			{
+				++nchunks;
+			}
+			if (nchunks == 0)
+			{
+				st.done = true;
+				return;
+			}
+
+			for (auto& b : st.batches)
+			{
+				b.clear();
+			}
+			auto encode = [&st](size_t ii) { encode_canonical_kmers(st.chunks[ii], st.k, st.batches[ii]); };
+			if (nchunks > 1)
+			{
+				std::vector<std::thread> workers;
+				workers.reserve(nchunks - 1);
+				for (size_t ii = 1; ii < nchunks; ++ii)
+				{
+					workers.emplace_back(encode, ii);
+				}
+				encode(0);
+				for (auto& t : workers)
+				{
+					t.join();
+				}
+			}
+			else
+			{
+				encode(0);
+			}
+			st.batch = 0;
+			st.pos = 0;
+		}
+	}
+
+	std::shared_ptr<state> _state;
+};
+
+/// Range of the canonical k-mers of a FASTA/FASTQ file, usable directly as mphf input
+/// kmer_t is uint64_t for k <= 32 or __uint128_t for k <= 64. Like any BBHash input, every k-mer must occur once
+/// (e.g. unitigs of a compacted de Bruijn graph); repeated k-mers end up in the fallback table.
+template <typename kmer_t = uint64_t> class kmer_file
+{
+public:
+	kmer_file(std::string filename, unsigned k, unsigned num_thread = 1, size_t chunk_bases = 1 << 20)
+	    : _filename(std::move(filename)), _k(k), _num_thread(num_thread), _chunk_bases(chunk_bases)
+	{
+		if (k == 0 || k > max_kmer_size_v<kmer_t>)
+		{
+			throw std::invalid_argument("k must be between 1 and " + std::to_string(max_kmer_size_v<kmer_t>));
+		}
+		if (chunk_bases < k)
+		{
+			throw std::invalid_argument("chunk_bases must be at least k");
+		}
+	}
+
+	[[nodiscard]] kmer_iterator<kmer_t> begin() const
+	{
+		return kmer_iterator<kmer_t>(_filename, _k, _num_thread, _chunk_bases);
+	}
+
+	[[nodiscard]] kmer_iterator<kmer_t> end() const { return kmer_iterator<kmer_t>(); }
+
+	/// Number of k-mers in the file (computed by a counting pass on first call)
+	[[nodiscard]] uint64_t size() const
+	{
+		if (!_size_known)
+		{
+			sequence_chunker chunker(_filename, _k, _chunk_bases);
+			std::string chunk;
+			_size = 0;
+			while (chunker.next(chunk))
+			{
+				_size += count_kmers(chunk, _k);
+			}
+			_size_known = true;
+		}
+		return _size;
+	}
+
+	[[nodiscard]] unsigned k() const noexcept { return _k; }
+
+private:
+	std::string _filename;
+	unsigned _k;
+	unsigned _num_thread;
+	size_t _chunk_bases;
+	mutable uint64_t _size{0};
+	mutable bool _size_known{false};
+};
+
+} // namespace boomphf
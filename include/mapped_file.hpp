@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#ifdef _WIN32
+#include "windows_sane.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace boomphf
+{
+
+////////////////////////////////////////////////////////////////
+// Memory-mapped files
+////////////////////////////////////////////////////////////////
+
+/// Read-only memory mapping of a whole file, advised for sequential access
+class mapped_file
+{
+public:
+	mapped_file() = default;
+
+	explicit mapped_file(const std::string& filename)
+	{
+#ifdef _WIN32
+		HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		                          FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			throw std::invalid_argument("Error opening " + filename);
+		}
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size))
+		{
+			CloseHandle(file);
+			throw std::runtime_error("Error reading the size of " + filename);
+		}
+		_size = static_cast<size_t>(size.QuadPart);
+		if (_size > 0)
+		{
+			HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping)
+			{
+				_data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+				CloseHandle(mapping);
+			}
+		}
+		CloseHandle(file);
+#else
+		const int fd = ::open(filename.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			throw std::invalid_argument("Error opening " + filename);
+		}
+		struct stat st;
+		if (::fstat(fd, &st) != 0)
+		{
+			::close(fd);
+			throw std::runtime_error("Error reading the size of " + filename);
+		}
+		_size = static_cast<size_t>(st.st_size);
+		if (_size > 0)
+		{
+			void* addr = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (addr != MAP_FAILED)
+			{
+				_data = static_cast<const char*>(addr);
+#ifdef MADV_SEQUENTIAL
+				::madvise(addr, _size, MADV_SEQUENTIAL);
+#endif
+			}
+		}
+		::close(fd);
+#endif
+		if (_size > 0 && !_data)
+		{
+			throw std::runtime_error("Error mapping " + filename);
+		}
+	}
+
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	mapped_file(mapped_file&& other) noexcept
+	    : _data(std::exchange(other._data, nullptr)), _size(std::exchange(other._size, 0))
+	{
+	}
+
+	mapped_file& operator=(mapped_file&& other) noexcept
+	{
+		if (this != &other)
+		{
+			unmap();
+			_data = std::exchange(other._data, nullptr);
+			_size = std::exchange(other._size, 0);
+		}
+		return *this;
+	}
+
+	~mapped_file() { unmap(); }
+
+	[[nodiscard]] const char* data() const noexcept { return _data; }
+	[[nodiscard]] size_t size() const noexcept { return _size; }
+
+private:
+	void unmap() noexcept
+	{
+		if (_data)
+		{
+#ifdef _WIN32
+			UnmapViewOfFile(_data);
+#else
+			::munmap(const_cast<char*>(_data), _size);
+#endif
+		}
+		_data = nullptr;
+		_size = 0;
+	}
+
+	const char* _data{nullptr};
+	size_t _size{0};
+};
+
+/// Binary file of fixed-size keys, read through a memory mapping
+/// Iterators are plain pointers, so the file is a random-access range: construction threads each take their own
+/// chunk of keys instead of funnelling reads through a single stream.
+template <typename type_elem> class file_binary
+{
+	static_assert(std::is_trivially_copyable_v<type_elem>, "file_binary maps raw bytes as type_elem");
+
+public:
+	using const_iterator = const type_elem*;
+
+	file_binary(file_binary&&) noexcept = default;
+	file_binary& operator=(file_binary&&) noexcept = default;
+
+	explicit file_binary(const std::string& filename) : _file(filename)
+	{
+		if (_file.size() % sizeof(type_elem) != 0)
+		{
+			throw std::invalid_argument(filename + " is not a whole number of " + std::to_string(sizeof(type_elem)) +
+			                            "-byte keys");
+		}
+	}
+
+	explicit file_binary(const char* filename) : file_binary(std::string(filename)) {}
+
+	[[nodiscard]] const_iterator begin() const noexcept { return reinterpret_cast<const type_elem*>(_file.data()); }
+
+	[[nodiscard]] const_iterator end() const noexcept { return begin() + size(); }
+
+	[[nodiscard]] size_t size() const noexcept { return _file.size() / sizeof(type_elem); }
+
+	[[nodiscard]] const type_elem& operator[](size_t idx) const noexcept { return begin()[idx]; }
+
+private:
+	mapped_file _file;
+};
+
+} // namespace boomphf
@@ -0,0 +1,301 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "BooPHF.h"
+#include "mphf_container.hpp"
+#include "packed_array.hpp"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace boomphf
+{
+
+////////////////////////////////////////////////////////////////
+// Monotone minimal perfect hashing (LCP bucketing)
+//
+// Sorted keys are cut into buckets of bucket_size consecutive keys. Within a bucket all keys share the longest common
+// prefix (in bits) of its first and last key, and no other bucket has the same prefix of the same length, so:
+//   rank(key) = bucket_of[prefix_mphf(prefix(key, lcp[key_mphf(key)]))] * bucket_size + offset[key_mphf(key)]
+// which costs about log2(bucket_size) + log2(key bits) bits per key on top of the key mphf.
+////////////////////////////////////////////////////////////////
+
+namespace detail
+{
+
+[[nodiscard]] inline uint32_t leading_zeros64(uint64_t x) noexcept
+{
+	if (x == 0)
+	{
+		return 64;
+	}
+#if defined(__GNUC__) || defined(__clang__)
+	return static_cast<uint32_t>(__builtin_clzll(x));
+#elif defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanReverse64(&index, x);
+	return 63 - index;
+#else
+	uint32_t n = 0;
+	while (!(x & (1ULL << 63)))
+	{
+		x <<= 1;
+		++n;
+	}
+	return n;
+#endif
+}
+
+/// Keys as bit strings whose order matches the key order: how to measure common prefixes and name a prefix
+template <typename Key, typename = void> struct monotone_bits
+{
+	static_assert(sizeof(Key) == 0, "monotone_mphf supports unsigned integer keys and std::string");
+};
+
+/// Unsigned integers: their bits, most significant first. A prefix is named by {prefix bits, length}.
+template <typename Key> struct monotone_bits<Key, std::enable_if_t<std::is_unsigned_v<Key> && (sizeof(Key) <= 8)>>
+{
+	using prefix_t = uint128_pair_t;
+	using prefix_hasher_t = Hasher128<prefix_t>;
+	static constexpr uint32_t WIDTH = 8 * sizeof(Key);
+
+	[[nodiscard]] static uint64_t length(Key) noexcept { return WIDTH; }
+
+	[[nodiscard]] static uint64_t common_prefix(Key a, Key b) noexcept
+	{
+		return leading_zeros64(static_cast<uint64_t>(a ^ b)) - (64 - WIDTH);
+	}
+
+	/// Calls fn with the name of the first bits of key; returns false when key has fewer bits
+	template <typename Fn> static bool with_prefix(Key key, uint64_t bits, Fn&& fn)
+	{
+		if (bits > WIDTH)
+		{
+			return false;
+		}
+		const uint64_t value = bits == 0 ? 0 : static_cast<uint64_t>(key) >> (WIDTH - bits);
+		fn(prefix_t{value, bits});
+		return true;
+	}
+};
+
+/// Byte strings, in std::string order (unsigned bytes): every byte is written as a 1 bit followed by its 8 bits, and
+/// the string ends with a 0 bit. No encoded string is a prefix of another, which keeps bucket prefixes distinct.
+/// A prefix of 9 * k + r bits is named by its first k bytes, r, and the r bits taken from the next 9-bit group.
+template <> struct monotone_bits<std::string>
+{
+	using prefix_t = std::string;
+	using prefix_hasher_t = StringHasher;
+
+	[[nodiscard]] static uint64_t length(std::string_view key) noexcept { return 9 * key.size() + 1; }
+
+	[[nodiscard]] static uint64_t common_prefix(std::string_view a, std::string_view b) noexcept
+	{
+		const size_t n = std::min(a.size(), b.size());
+		size_t i = 0;
+		while (i < n && a[i] == b[i])
+		{
+			++i;
+		}
+		if (i == n)
+		{
+			return a.size() == b.size() ? length(a) : 9 * i; // the shorter one ends where the other continues
+		}
+		const auto x = static_cast<uint8_t>(a[i] ^ b[i]);
+		return 9 * i + 1 + (leading_zeros64(x) - 56);
+	}
+
+	template <typename Fn> static bool with_prefix(std::string_view key, uint64_t bits, Fn&& fn)
+	{
+		if (bits > length(key))
+		{
+			return false;
+		}
+		const size_t k = static_cast<size_t>(bits / 9);
+		const auto r = static_cast<uint32_t>(bits % 9);
+		const uint32_t group = k < key.size() ? (0x100u | static_cast<uint8_t>(key[k])) : 0u;
+		const uint32_t partial = r == 0 ? 0 : group >> (9 - r);
+
+		// Lookups of short prefixes are named in a stack buffer, so they do not allocate
+		char local[128];
+		std::string heap;
+		char* name = local;
+		if (k + 2 > sizeof(local))
+		{
+			heap.resize(k + 2);
+			name = heap.data();
+		}
+		std::copy(key.data(), key.data() + k, name);
+		name[k] = static_cast<char>(r);
+		name[k + 1] = static_cast<char>(partial);
+		fn(std::string_view(name, k + 2));
+		return true;
+	}
+};
+
+} // namespace detail
+
+/// Order-preserving minimal perfect hash: for keys given in strictly increasing order, lookup() returns the rank of a
+/// key in that order, so ranges of keys map to ranges of ids (e.g. dictionary codes that keep range predicates).
+/// Supports unsigned integer keys and std::string (compared as unsigned bytes). Other keys map to unspecified ids,
+/// or to ULLONG_MAX when they are detected as absent.
+template <typename Key, typename Hasher_t = SingleHashFunctor<Key>> class monotone_mphf
+{
+	using bits_t = detail::monotone_bits<typename key_traits<Key>::value_type>;
+	using prefix_mphf_t = mphf<typename bits_t::prefix_t, typename bits_t::prefix_hasher_t>;
+
+public:
+	using mphf_t = mphf<Key, Hasher_t>;
+	using key_view_t = typename key_traits<Key>::view_type;
+
+	static constexpr uint64_t MAGIC = 0x01004E4F4D484242ULL; // "BBHMON\0\1" in little-endian byte order
+
+	monotone_mphf() : _key_hash(std::make_unique<mphf_t>()), _prefix_hash(std::make_unique<prefix_mphf_t>()) {}
+
+	/// sorted_keys is a random-access range in strictly increasing order; both mphfs are built on num_thread threads
+	template <typename KeyRange>
+	explicit monotone_mphf(const KeyRange& sorted_keys, uint32_t bucket_size = 256, int num_thread = 1,
+	                       double gamma = 2.0)
+	    : _bucket_size(bucket_size)
+	{
+		const uint64_t n = sorted_keys.size();
+		if (n == 0)
+		{
+			throw std::invalid_argument("monotone_mphf needs at least one key");
+		}
+		if (bucket_size == 0)
+		{
+			throw std::invalid_argument("monotone_mphf bucket size must be positive");
+		}
+		for (uint64_t i = 1; i < n; ++i)
+		{
+			if (!(sorted_keys[i - 1] < sorted_keys[i]))
+			{
+				throw std::invalid_argument("monotone_mphf keys must be sorted and distinct");
+			}
+		}
+		const auto nthreads = static_cast<unsigned>(std::max(1, num_thread));
+
+		// One prefix per bucket
+		const uint64_t nb_buckets = (n + bucket_size - 1) / bucket_size;
+		std::vector<uint64_t> bucket_prefix_bits(nb_buckets);
+		std::vector<typename bits_t::prefix_t> prefixes(nb_buckets);
+		uint64_t max_bits = 0;
+		for (uint64_t b = 0; b < nb_buckets; ++b)
+		{
+			const key_view_t first = sorted_keys[b * bucket_size];
+			const key_view_t last = sorted_keys[std::min(n, (b + 1) * bucket_size) - 1];
+			const uint64_t bits = bits_t::common_prefix(first, last);
+			bucket_prefix_bits[b] = bits;
+			max_bits = std::max(max_bits, bits);
+			[[maybe_unused]] const bool ok =
+			    bits_t::with_prefix(first, bits, [&](const auto& prefix) { prefixes[b] = prefix; });
+		}
+
+		_prefix_hash = std::make_unique<prefix_mphf_t>(nb_buckets, prefixes, num_thread, gamma, false, false);
+		_bucket_of = packed_array(nb_buckets, bits_needed(nb_buckets - 1));
+		std::vector<bool> taken(nb_buckets);
+		for (uint64_t b = 0; b < nb_buckets; ++b)
+		{
+			const uint64_t slot = _prefix_hash->lookup(prefixes[b]);
+			if (slot >= nb_buckets || taken[slot])
+			{
+				throw std::logic_error("monotone_mphf bucket prefixes are not distinct");
+			}
+			taken[slot] = true;
+			_bucket_of.atomic_set(slot, b);
+		}
+
+		_key_hash = std::make_unique<mphf_t>(n, sorted_keys, num_thread, gamma, false, false);
+		_prefix_bits = packed_array(n, bits_needed(max_bits));
+		_offsets = packed_array(n, bits_needed(bucket_size - 1));
+		detail::parallel_slices(n, nthreads,
+		                        [&](uint64_t begin, uint64_t end)
+		                        {
+			                        for (uint64_t i = begin; i < end; ++i)
+			                        {
+				                        const uint64_t idx = _key_hash->lookup(sorted_keys[i]);
+				                        _prefix_bits.atomic_set(idx, bucket_prefix_bits[i / bucket_size]);
+				                        _offsets.atomic_set(idx, i % bucket_size);
+			                        }
+		                        });
+	}
+
+	/// Rank of key among the construction keys
+	[[nodiscard]] uint64_t lookup(const key_view_t& key) const
+	{
+		const uint64_t idx = _key_hash->lookup(key);
+		if (idx >= _offsets.size())
+		{
+			return ULLONG_MAX;
+		}
+		_offsets.prefetch(idx);
+
+		uint64_t slot = ULLONG_MAX;
+		if (!bits_t::with_prefix(key, _prefix_bits.get(idx),
+		                         [&](const auto& prefix) { slot = _prefix_hash->lookup(prefix); }) ||
+		    slot >= _bucket_of.size())
+		{
+			return ULLONG_MAX;
+		}
+		return _bucket_of.get(slot) * _bucket_size + _offsets.get(idx);
+	}
+
+	[[nodiscard]] uint64_t nbKeys() const noexcept { return _offsets.size(); }
+	[[nodiscard]] uint32_t bucketSize() const noexcept { return _bucket_size; }
+
+	/// Bits used by the per-key prefix lengths and offsets and the bucket table, on top of the two mphfs
+	[[nodiscard]] uint64_t rankBitSize() const noexcept
+	{
+		return _prefix_bits.bitSize() + _offsets.bitSize() + _bucket_of.bitSize();
+	}
+
+	void save(std::ostream& os) const
+	{
+		detail::save_container_header(os, MAGIC, 0, nbKeys(), *_key_hash);
+		write_le(os, _bucket_size);
+		write_le(os, uint32_t(0));
+		_prefix_bits.save(os);
+		_offsets.save(os);
+		_bucket_of.save(os);
+		_prefix_hash->save(os);
+	}
+
+	void load(std::istream& is)
+	{
+		uint64_t nkeys;
+		uint32_t reserved;
+		[[maybe_unused]] const uint32_t flags = detail::load_container_header(is, MAGIC, nkeys, *_key_hash);
+		read_le(is, _bucket_size);
+		read_le(is, reserved);
+		_prefix_bits.load(is);
+		_offsets.load(is);
+		_bucket_of.load(is);
+		_prefix_hash->load(is);
+		if (_offsets.size() != nkeys || _prefix_bits.size() != nkeys || _bucket_size == 0)
+		{
+			throw std::runtime_error("Corrupted monotone_mphf");
+		}
+	}
+
+private:
+	std::unique_ptr<mphf_t> _key_hash;
+	std::unique_ptr<prefix_mphf_t> _prefix_hash;
+	packed_array _prefix_bits; // by key slot: length of its bucket prefix
+	packed_array _offsets;     // by key slot: position in its bucket
+	packed_array _bucket_of;   // by prefix slot: bucket number
+	uint32_t _bucket_size{256};
+};
+
+} // namespace boomphf
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "endian_utils.hpp"
+#include "stored_keys.hpp"
+
+namespace boomphf
+{
+
+////////////////////////////////////////////////////////////////
+// Static containers built on mphf
+//
+// Shared file layout (all sections little-endian and 8-byte aligned, so the bulky parts can be memory-mapped):
+//   header  : magic (u64), version (u32), flags (u32), key count (u64), mphf bytes (u64)
+//   mphf    : mphf::save() output, zero padding to 8 bytes
+//   payload : container specific (packed values, stored keys)
+////////////////////////////////////////////////////////////////
+
+inline constexpr uint32_t MPHF_CONTAINER_VERSION = 1;
+
+namespace detail
+{
+
+inline constexpr uint32_t CONTAINER_FLAG_KEYS = 1; // stored keys section present
+
+/// Run fn(begin, end) over [0, n) split into num_thread slices, rethrowing the first exception
+template <typename Fn> void parallel_slices(uint64_t n, unsigned num_thread, Fn fn)
+{
+	num_thread = std::max(1u, num_thread);
+	std::exception_ptr error;
+	std::mutex error_mutex;
+	const auto run = [&](uint64_t begin, uint64_t end)
+	{
+		try
+		{
+			fn(begin, end);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(error_mutex);
+			error = std::current_exception();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	workers.reserve(num_thread - 1);
+	const uint64_t slice = (n + num_thread - 1) / num_thread;
+	for (unsigned t = 1; t < num_thread; ++t)
+	{
+		workers.emplace_back(run, std::min(n, t * slice), std::min(n, (t + 1) * slice));
+	}
+	run(0, std::min(n, slice));
+	for (auto& w : workers)
+	{
+		w.join();
+	}
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+}
+
+template <typename Mphf>
+void save_container_header(std::ostream& os, uint64_t magic, uint32_t flags, uint64_t nkeys, const Mphf& bphf)
+{
+	std::ostringstream blob;
+	bphf.save(blob);
+	const std::string bytes = blob.str();
+
+	write_le(os, magic);
+	write_le(os, MPHF_CONTAINER_VERSION);
+	write_le(os, flags);
+	write_le(os, nkeys);
+	write_le(os, static_cast<uint64_t>(bytes.size()));
+	os.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+	write_padding(os, bytes.size());
+}
+
+/// Returns the flags; the mphf is read into memory (it is small next to the payload)
+template <typename Mphf>
+uint32_t load_container_header(std::istream& is, uint64_t magic, uint64_t& nkeys, Mphf& bphf)
+{
+	uint64_t file_magic, mphf_bytes;
+	uint32_t version, flags;
+	read_le(is, file_magic);
+	if (!is || file_magic != magic)
+	{
+		throw std::runtime_error("Not a serialized container of this type");
+	}
+	read_le(is, version);
+	if (version > MPHF_CONTAINER_VERSION)
+	{
+		throw std::runtime_error("Unsupported container format version " + std::to_string(version));
+	}
+	read_le(is, flags);
+	read_le(is, nkeys);
+	read_le(is, mphf_bytes);
+	bphf.load(is);
+	skip_padding(is, mphf_bytes);
+	return flags;
+}
+
+template <typename Mphf>
+uint32_t map_container_header(mapped_cursor& cursor, uint64_t magic, uint64_t& nkeys, Mphf& bphf)
+{
+	if (cursor.read<uint64_t>() != magic)
+	{
+		throw std::runtime_error("Not a serialized container of this type");
+	}
+	const auto version = cursor.read<uint32_t>();
+	if (version > MPHF_CONTAINER_VERSION)
+	{
+		throw std::runtime_error("Unsupported container format version " + std::to_string(version));
+	}
+	const auto flags = cursor.read<uint32_t>();
+	nkeys = cursor.read<uint64_t>();
+	const auto mphf_bytes = cursor.read<uint64_t>();
+	const char* blob = cursor.take_section(mphf_bytes);
+	memory_streambuf buf(blob, mphf_bytes);
+	std::istream is(&buf);
+	bphf.load(is);
+	return flags;
+}
+
+} // namespace detail
+
+} // namespace boomphf
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "BooPHF.h"
+#include "mapped_file.hpp"
+#include "mphf_container.hpp"
+#include "packed_array.hpp"
+#include "stored_keys.hpp"
+
+namespace boomphf
+{
+
+/// Static map from a fixed key set to small unsigned values (or enums), stored in MPHF order in a bit-packed array
+/// With verify_keys, the keys are stored as well so that find() rejects keys outside the set; otherwise looking up an
+/// unknown key returns the value of some arbitrary key.
+template <typename Key, typename Value, typename Hasher_t = SingleHashFunctor<Key>> class mphf_map
+{
+	static_assert(std::is_unsigned_v<Value> || std::is_enum_v<Value>,
+	              "mphf_map values are unsigned integers or enums, stored in bits_per_value bits");
+
+public:
+	using mphf_t = mphf<Key, Hasher_t>;
+	using key_view_t = typename key_traits<Key>::view_type;
+	using key_value_t = typename key_traits<Key>::value_type;
+
+	static constexpr uint64_t MAGIC = 0x010050414D484242ULL; // "BBHMAP\0\1" in little-endian byte order
+
+	mphf_map() : _bphf(std::make_unique<mphf_t>()) {}
+
+	/// keys and values are random-access ranges of the same size; values[i] is the value of keys[i]
+	/// bits_per_value = 0 picks the width of the largest value.
+	template <typename KeyRange, typename ValueRange>
+	mphf_map(const KeyRange& keys, const ValueRange& values, uint32_t bits_per_value = 0, bool verify_keys = false,
+	         int num_thread = 1, double gamma = 2.0)
+	{
+		const uint64_t n = keys.size();
+		if (static_cast<uint64_t>(values.size()) != n)
+		{
+			throw std::invalid_argument("mphf_map needs one value per key");
+		}
+		if (bits_per_value == 0)
+		{
+			uint64_t max_value = 0;
+			for (uint64_t i = 0; i < n; ++i)
+			{
+				max_value = std::max(max_value, to_bits(values[i]));
+			}
+			bits_per_value = bits_needed(max_value);
+		}
+
+		_bphf = std::make_unique<mphf_t>(n, keys, num_thread, gamma, false, false);
+		_values = packed_array(n, bits_per_value);
+		const uint64_t limit = bits_per_value == 64 ? ~0ULL : ((1ULL << bits_per_value) - 1);
+
+		std::vector<key_value_t> ordered_keys(verify_keys ? n : 0);
+		bitVector placed(n); // a duplicated key lands on an index already taken, or past n
+		detail::parallel_slices(n, static_cast<unsigned>(std::max(1, num_thread)),
+		                        [&](uint64_t begin, uint64_t end)
+		                        {
+			                        for (uint64_t i = begin; i < end; ++i)
+			                        {
+				                        const uint64_t v = to_bits(values[i]);
+				                        if (v > limit)
+				                        {
+					                        throw std::invalid_argument("value does not fit in bits_per_value bits");
+				                        }
+				                        const uint64_t idx = _bphf->lookup(keys[i]);
+				                        if (idx >= n || placed.atomic_test_and_set(idx))
+				                        {
+					                        throw std::invalid_argument("mphf_map keys must be distinct");
+				                        }
+				                        _values.atomic_set(idx, v);
+				                        if (verify_keys)
+				                        {
+					                        ordered_keys[idx] = keys[i];
+				                        }
+			                        }
+		                        });
+		if (verify_keys)
+		{
+			_keys.assign(std::move(ordered_keys));
+			_verify = true;
+		}
+	}
+
+	[[nodiscard]] uint64_t size() const noexcept { return _bphf->nbKeys(); }
+	[[nodiscard]] uint32_t bitsPerValue() const noexcept { return _values.width(); }
+	[[nodiscard]] bool verifiesKeys() const noexcept { return _verify; }
+	[[nodiscard]] const mphf_t& hash() const noexcept { return *_bphf; }
+
+	/// Value of a key of the set (unspecified for other keys)
+	[[nodiscard]] Value get(const key_view_t& key) const
+	{
+		const uint64_t idx = _bphf->lookup(key);
+		return idx < _values.size() ? from_bits(_values.get(idx)) : Value{};
+	}
+
+	/// Value of key, or nullopt when the key is known not to be in the set (always detected with verify_keys)
+	[[nodiscard]] std::optional<Value> find(const key_view_t& key) const
+	{
+		const uint64_t idx = _bphf->lookup(key);
+		if (idx >= _values.size() || (_verify && !(_keys.at(idx) == key)))
+		{
+			return std::nullopt;
+		}
+		return from_bits(_values.get(idx));
+	}
+
+	/// Batch get: out[i] = value of keys[i], or missing for keys rejected as in find(); returns the number found
+	/// Slots of a whole block are computed first and their value words prefetched before any is read.
+	template <typename KeyIt> uint64_t get(KeyIt keys, uint64_t n, Value* out, Value missing = Value{}) const
+	{
+		constexpr uint64_t BLOCK = 32;
+		uint64_t idx[BLOCK];
+		uint64_t found = 0;
+		for (uint64_t begin = 0; begin < n; begin += BLOCK)
+		{
+			const uint64_t count = std::min(BLOCK, n - begin);
+			for (uint64_t j = 0; j < count; ++j)
+			{
+				idx[j] = _bphf->lookup(keys[begin + j]);
+				if (idx[j] < _values.size())
+				{
+					_values.prefetch(idx[j]);
+				}
+			}
+			for (uint64_t j = 0; j < count; ++j)
+			{
+				if (idx[j] >= _values.size() || (_verify && !(_keys.at(idx[j]) == key_view_t(keys[begin + j]))))
+				{
+					out[begin + j] = missing;
+				}
+				else
+				{
+					out[begin + j] = from_bits(_values.get(idx[j]));
+					++found;
+				}
+			}
+		}
+		return found;
+	}
+
+	/// Bits used by the values and stored keys, on top of the mphf itself
+	[[nodiscard]] uint64_t payloadBitSize() const noexcept
+	{
+		return _values.bitSize() + (_verify ? _keys.bitSize() : 0);
+	}
+
+	void save(std::ostream& os) const
+	{
+		detail::save_container_header(os, MAGIC, _verify ? detail::CONTAINER_FLAG_KEYS : 0, size(), *_bphf);
+		_values.save(os);
+		if (_verify)
+		{
+			_keys.save(os);
+		}
+	}
+
+	void load(std::istream& is)
+	{
+		_mapping.reset();
+		uint64_t nkeys;
+		const uint32_t flags = detail::load_container_header(is, MAGIC, nkeys, *_bphf);
+		_values.load(is);
+		_verify = (flags & detail::CONTAINER_FLAG_KEYS) != 0;
+		if (_verify)
+		{
+			_keys.load(is);
+		}
+		check_size(nkeys);
+	}
+
+	/// Memory-map a file written by save(): the values and stored keys are used in place, only the mphf is read
+	/// into memory. Big-endian hosts fall back to load().
+	void load_mapped(const std::string& filename)
+	{
+		if (!is_system_little_endian())
+		{
+			std::ifstream is(filename, std::ios::binary);
+			load(is);
+			return;
+		}
+
+		auto mapping = std::make_shared<mapped_file>(filename);
+		detail::mapped_cursor cursor(mapping->data(), mapping->size());
+		uint64_t nkeys;
+		const uint32_t flags = detail::map_container_header(cursor, MAGIC, nkeys, *_bphf);
+
+		const auto n = cursor.read<uint64_t>();
+		const auto width = cursor.read<uint32_t>();
+		[[maybe_unused]] const auto reserved = cursor.read<uint32_t>();
+		if (width == 0 || width > 64)
+		{
+			throw std::runtime_error("Corrupted mphf_map values");
+		}
+		const char* words = cursor.take(packed_array::word_count(n, width) * 8);
+		_values = packed_array::view(reinterpret_cast<const uint64_t*>(words), n, width);
+
+		_verify = (flags & detail::CONTAINER_FLAG_KEYS) != 0;
+		if (_verify)
+		{
+			_keys.map(cursor);
+		}
+		check_size(nkeys);
+		_mapping = std::move(mapping);
+	}
+
+private:
+	void check_size(uint64_t nkeys) const
+	{
+		if (_values.size() != nkeys || _bphf->nbKeys() != nkeys || (_verify && _keys.size() != nkeys))
+		{
+			throw std::runtime_error("Corrupted mphf_map: key count mismatch");
+		}
+	}
+
+	[[nodiscard]] static uint64_t to_bits(Value v) noexcept
+	{
+		if constexpr (std::is_enum_v<Value>)
+		{
+			return static_cast<uint64_t>(static_cast<std::underlying_type_t<Value>>(v));
+		}
+		else
+		{
+			return static_cast<uint64_t>(v);
+		}
+	}
+
+	[[nodiscard]] static Value from_bits(uint64_t v) noexcept
+	{
+		if constexpr (std::is_enum_v<Value>)
+		{
+			return static_cast<Value>(static_cast<std::underlying_type_t<Value>>(v));
+		}
+		else
+		{
+			return static_cast<Value>(v);
+		}
+	}
+
+	std::unique_ptr<mphf_t> _bphf;
+	packed_array _values;
+	stored_keys<Key> _keys;
+	bool _verify{false};
+	std::shared_ptr<mapped_file> _mapping; // keeps mapped sections alive
+};
+
+} // namespace boomphf
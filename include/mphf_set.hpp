@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "BooPHF.h"
+#include "mapped_file.hpp"
+#include "mphf_container.hpp"
+#include "stored_keys.hpp"
+
+namespace boomphf
+{
+
+/// Exact static set: the keys are stored in MPHF order, so membership is one lookup plus one key compare (no false
+/// positives) and ids map back to keys with key_at(), e.g. for dictionary encoding and decoding.
+template <typename Key, typename Hasher_t = SingleHashFunctor<Key>> class mphf_set
+{
+public:
+	using mphf_t = mphf<Key, Hasher_t>;
+	using key_view_t = typename key_traits<Key>::view_type;
+	using key_value_t = typename key_traits<Key>::value_type;
+
+	static constexpr uint64_t MAGIC = 0x0100544553484242ULL; // "BBHSET\0\1" in little-endian byte order
+
+	mphf_set() : _bphf(std::make_unique<mphf_t>()) {}
+
+	/// keys is a random-access range of distinct keys; construction and the permutation of the keys into MPHF order
+	/// both run on num_thread threads
+	template <typename KeyRange> explicit mphf_set(const KeyRange& keys, int num_thread = 1, double gamma = 2.0)
+	{
+		const uint64_t n = keys.size();
+		_bphf = std::make_unique<mphf_t>(n, keys, num_thread, gamma, false, false);
+
+		std::vector<key_value_t> ordered_keys(n);
+		bitVector placed(n); // a duplicated key lands on an id already taken, or past n
+		detail::parallel_slices(n, static_cast<unsigned>(std::max(1, num_thread)),
+		                        [&](uint64_t begin, uint64_t end)
+		                        {
+			                        for (uint64_t i = begin; i < end; ++i)
+			                        {
+				                        const uint64_t idx = _bphf->lookup(keys[i]);
+				                        if (idx >= n || placed.atomic_test_and_set(idx))
+				                        {
+					                        throw std::invalid_argument("mphf_set keys must be distinct");
+				                        }
+				                        ordered_keys[idx] = keys[i];
+			                        }
+		                        });
+		_keys.assign(std::move(ordered_keys));
+	}
+
+	[[nodiscard]] uint64_t size() const noexcept { return _keys.size(); }
+	[[nodiscard]] const mphf_t& hash() const noexcept { return *_bphf; }
+
+	/// Id of key in [0, size()), or ULLONG_MAX when key is not in the set
+	[[nodiscard]] uint64_t id(const key_view_t& key) const
+	{
+		const uint64_t idx = _bphf->lookup(key);
+		return idx < _keys.size() && _keys.at(idx) == key ? idx : ULLONG_MAX;
+	}
+
+	[[nodiscard]] bool contains(const key_view_t& key) const { return id(key) != ULLONG_MAX; }
+
+	/// Key with the given id (reverse of id()); for string keys the view points into the set
+	[[nodiscard]] key_view_t key_at(uint64_t id) const
+	{
+		if (id >= _keys.size())
+		{
+			throw std::out_of_range("mphf_set id out of range");
+		}
+		return _keys.at(id);
+	}
+
+	/// Bits used by the stored keys, on top of the mphf itself
+	[[nodiscard]] uint64_t payloadBitSize() const noexcept { return _keys.bitSize(); }
+
+	void save(std::ostream& os) const
+	{
+		detail::save_container_header(os, MAGIC, detail::CONTAINER_FLAG_KEYS, size(), *_bphf);
+		_keys.save(os);
+	}
+
+	void load(std::istream& is)
+	{
+		_mapping.reset();
+		uint64_t nkeys;
+		[[maybe_unused]] const uint32_t flags = detail::load_container_header(is, MAGIC, nkeys, *_bphf);
+		_keys.load(is);
+		check_size(nkeys);
+	}
+
+	/// Memory-map a file written by save(): the stored keys are used in place, only the mphf is read into memory.
+	/// Big-endian hosts fall back to load().
+	void load_mapped(const std::string& filename)
+	{
+		if (!is_system_little_endian())
+		{
+			std::ifstream is(filename, std::ios::binary);
+			load(is);
+			return;
+		}
+
+		auto mapping = std::make_shared<mapped_file>(filename);
+		detail::mapped_cursor cursor(mapping->data(), mapping->size());
+		uint64_t nkeys;
+		[[maybe_unused]] const uint32_t flags = detail::map_container_header(cursor, MAGIC, nkeys, *_bphf);
+		_keys.map(cursor);
+		check_size(nkeys);
+		_mapping = std::move(mapping);
+	}
+
+private:
+	void check_size(uint64_t nkeys) const
+	{
+		if (_keys.size() != nkeys || _bphf->nbKeys() != nkeys)
+		{
+			throw std::runtime_error("Corrupted mphf_set: key count mismatch");
+		}
+	}
+
+	std::unique_ptr<mphf_t> _bphf;
+	stored_keys<Key> _keys;
+	std::shared_ptr<mapped_file> _mapping; // keeps the mapped keys alive
+};
+
+} // namespace boomphf
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "bit_kernels.hpp"
+#include "endian_utils.hpp"
+
+#if defined(_WIN32) || defined(_MSC_VER)
+#include "windows_sane.h" // For InterlockedOr64
+#endif
+
+namespace boomphf
+{
+
+/// Number of bits needed to store v (at least 1)
+[[nodiscard]] inline uint32_t bits_needed(uint64_t v) noexcept
+{
+	uint32_t bits = 1;
+	while (bits < 64 && (v >> bits) != 0)
+	{
+		++bits;
+	}
+	return bits;
+}
+
+/// Fixed-width unsigned integers (1 to 64 bits each) packed back to back in 64-bit words
+/// Words are kept in little-endian byte order, as in the serialized form, so an array can either own its words or be
+/// a read-only view into external memory such as a memory-mapped file (see view()).
+class packed_array
+{
+public:
+	packed_array() = default;
+
+	packed_array(uint64_t n, uint32_t width) : _size(n), _width(width)
+	{
+		if (width == 0 || width > 64)
+		{
+			throw std::invalid_argument("packed_array width must be between 1 and 64 bits");
+		}
+		_owned.assign(word_count(n, width), 0);
+		_words = _owned.data();
+	}
+
+	packed_array(const packed_array& r) : _owned(r._owned), _size(r._size), _width(r._width)
+	{
+		_words = r.is_view() ? r._words : _owned.data();
+	}
+
+	packed_array& operator=(const packed_array& r)
+	{
+		if (this != &r)
+		{
+			_owned = r._owned;
+			_size = r._size;
+			_width = r._width;
+			_words = r.is_view() ? r._words : _owned.data();
+		}
+		return *this;
+	}
+
+	packed_array(packed_array&& r) noexcept { *this = std::move(r); }
+
+	packed_array& operator=(packed_array&& r) noexcept
+	{
+		if (this != &r)
+		{
+			const bool view = r.is_view();
+			_owned = std::move(r._owned);
+			_size = r._size;
+			_width = r._width;
+			_words = view ? r._words : _owned.data();
+			r._words = nullptr;
+			r._size = 0;
+		}
+		return *this;
+	}
+
+	/// Read-only array over word_count(n, width) little-endian words owned by someone else
+	[[nodiscard]] static packed_array view(const uint64_t* words, uint64_t n, uint32_t width)
+	{
+		packed_array a;
+		a._words = words;
+		a._size = n;
+		a._width = width;
+		return a;
+	}
+
+	/// Words used for n values of width bits, including one word of padding so that get() can always read two
+	[[nodiscard]] static uint64_t word_count(uint64_t n, uint32_t width) noexcept { return (n * width + 63) / 64 + 1; }
+
+	[[nodiscard]] uint64_t size() const noexcept { return _size; }
+	[[nodiscard]] uint32_t width() const noexcept { return _width; }
+	[[nodiscard]] bool is_view() const noexcept { return _words != nullptr && _owned.empty(); }
+	[[nodiscard]] uint64_t bitSize() const noexcept { return word_count(_size, _width) * 64; }
+
+	[[nodiscard]] uint64_t get(uint64_t i) const noexcept
+	{
+		const uint64_t bit = i * _width;
+		const uint64_t word = bit >> 6;
+		const unsigned shift = bit & 63;
+		uint64_t v = from_little_endian(_words[word]) >> shift;
+		if (shift + _width > 64)
+		{
+			v |= from_little_endian(_words[word + 1]) << (64 - shift);
+		}
+		return v & mask();
+	}
+
+	/// Store v at i; the slot must still be zero. Safe to call concurrently for different slots.
+	void atomic_set(uint64_t i, uint64_t v) noexcept
+	{
+		const uint64_t bit = i * _width;
+		const uint64_t word = bit >> 6;
+		const unsigned shift = bit & 63;
+		v &= mask();
+		atomic_or(_owned[word], to_little_endian(v << shift));
+		if (shift + _width > 64)
+		{
+			atomic_or(_owned[word + 1], to_little_endian(v >> (64 - shift)));
+		}
+	}
+
+	void prefetch(uint64_t i) const noexcept { prefetch_read(_words + ((i * _width) >> 6)); }
+
+	[[nodiscard]] const uint64_t* words() const noexcept { return _words; }
+
+	/// Serialized layout: size (u64), width (u32), reserved (u32), then word_count() little-endian words
+	static constexpr size_t HEADER_BYTES = 16;
+
+	void save(std::ostream& os) const
+	{
+		write_le(os, _size);
+		write_le(os, _width);
+		write_le(os, uint32_t(0)); // keeps the words 8-byte aligned in the file
+		os.write(reinterpret_cast<const char*>(_words), static_cast<std::streamsize>(word_count(_size, _width) * 8));
+	}
+
+	void load(std::istream& is)
+	{
+		uint32_t reserved;
+		read_le(is, _size);
+		read_le(is, _width);
+		read_le(is, reserved);
+		if (_width == 0 || _width > 64)
+		{
+			throw std::runtime_error("Corrupted packed_array width");
+		}
+		_owned.resize(word_count(_size, _width));
+		is.read(reinterpret_cast<char*>(_owned.data()), static_cast<std::streamsize>(_owned.size() * 8));
+		_words = _owned.data();
+	}
+
+private:
+	[[nodiscard]] uint64_t mask() const noexcept { return _width == 64 ? ~0ULL : ((1ULL << _width) - 1); }
+
+	static void atomic_or(uint64_t& target, uint64_t bits) noexcept
+	{
+#if defined(_WIN32) || defined(_MSC_VER)
+		InterlockedOr64(reinterpret_cast<volatile LONG64*>(&target), static_cast<LONG64>(bits));
+#else
+		__atomic_fetch_or(&target, bits, __ATOMIC_RELAXED);
+#endif
+	}
+
+	std::vector<uint64_t> _owned;
+	const uint64_t* _words{nullptr};
+	uint64_t _size{0};
+	uint32_t _width{1};
+};
+
+} // namespace boomphf
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "BooPHF.h"
+
+namespace boomphf
+{
+
+////////////////////////////////////////////////////////////////
+// In-place permutation of value columns into MPHF order
+////////////////////////////////////////////////////////////////
+
+namespace detail
+{
+
+template <typename Tuple, size_t... I, typename... Columns>
+inline void swap_with_columns(Tuple& carry, uint64_t pos, std::index_sequence<I...>, Columns&... columns)
+{
+	using std::swap;
+	(swap(std::get<I>(carry), columns[pos]), ...);
+}
+
+template <typename Tuple, size_t... I, typename... Columns>
+inline void store_to_columns(Tuple& carry, uint64_t pos, std::index_sequence<I...>, Columns&... columns)
+{
+	((columns[pos] = std::move(std::get<I>(carry))), ...);
+}
+
+} // namespace detail
+
+/// Reorder one or more value columns in place so that column[bphf.lookup(keys[i])] holds the value that was at
+/// column[i], for i in [0, n)
+/// keys must be exactly the key set of bphf (any order, random access) and are not modified; columns are random-access
+/// containers or pointers of n elements. Permutation cycles are followed on num_thread threads, each starting cycles
+/// in its own slice: every position costs one lookup, and the only extra memory is two bits per position (claimed /
+/// saved) instead of a second copy of the values. A thread whose cycle reaches a position claimed by another thread as
+/// a cycle start hands its value over there and stops, so the threads split long cycles between them.
+template <typename Key, typename Hasher_t, typename KeyIt, typename... Columns>
+void permute_to_mphf_order(const mphf<Key, Hasher_t>& bphf, KeyIt keys, uint64_t n, unsigned num_thread,
+                           Columns&&... columns)
+{
+	static_assert(sizeof...(Columns) > 0, "at least one value column is needed");
+	using carry_t = std::tuple<std::decay_t<decltype(columns[0])>...>;
+	constexpr auto column_ids = std::index_sequence_for<Columns...>{};
+
+	bitVector claimed(n);
+	bitVector saved(n);
+	std::exception_ptr error;
+	std::mutex error_mutex;
+
+	const auto follow_cycles = [&](uint64_t begin, uint64_t end)
+	{
+		try
+		{
+			for (uint64_t start = begin; start < end; ++start)
+			{
+				if (claimed.atomic_get(start) || claimed.atomic_test_and_set(start))
+				{
+					continue;
+				}
+				carry_t carry(columns[start]...);
+				[[maybe_unused]] auto was_saved = saved.atomic_test_and_set(start);
+
+				uint64_t pos = start;
+				for (;;)
+				{
+					const uint64_t dest = bphf.lookup(keys[pos]);
+					if (dest >= n)
+					{
+						throw std::invalid_argument("permute_to_mphf_order: key not in the MPHF key set");
+					}
+					if (claimed.atomic_test_and_set(dest))
+					{
+						// Start of another cycle walk (possibly ours): its value has been or is being saved
+						while (!saved.atomic_get(dest))
+						{
+							std::this_thread::yield();
+						}
+						detail::store_to_columns(carry, dest, column_ids, columns...);
+						break;
+					}
+					detail::swap_with_columns(carry, dest, column_ids, columns...);
+					was_saved = saved.atomic_test_and_set(dest);
+					pos = dest;
+				}
+			}
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(error_mutex);
+			error = std::current_exception();
+		}
+	};
+
+	num_thread = std::max(1u, num_thread);
+	std::vector<std::thread> workers;
+	workers.reserve(num_thread - 1);
+	const uint64_t slice = (n + num_thread - 1) / num_thread;
+	for (unsigned t = 1; t < num_thread; ++t)
+	{
+		workers.emplace_back(follow_cycles, std::min(n, t * slice), std::min(n, (t + 1) * slice));
+	}
+	follow_cycles(0, std::min(n, slice));
+	for (auto& w : workers)
+	{
+		w.join();
+	}
+
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+}
+
+} // namespace boomphf
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BooPHF.h"
+
+namespace boomphf
+{
+
+////////////////////////////////////////////////////////////////
+// Bulk relabeling: keys -> dense ids
+////////////////////////////////////////////////////////////////
+
+/// Look up keys[0..n) into ids[0..n) on num_thread threads, each taking one contiguous slice
+/// Keys outside the MPHF key set get whatever mphf::lookup returns for them (see "Querying keys that are not in the
+/// input set" in the README).
+template <typename Key, typename Hasher_t, typename KeyIt>
+void relabel(const mphf<Key, Hasher_t>& bphf, KeyIt keys, size_t n, uint64_t* ids, unsigned num_thread = 1)
+{
+	const auto lookup_slice = [&](size_t begin, size_t end)
+	{
+		for (size_t ii = begin; ii < end; ++ii)
+		{
+			ids[ii] = bphf.lookup(keys[ii]);
+		}
+	};
+
+	num_thread = std::max(1u, num_thread);
+	if (num_thread == 1 || n < num_thread)
+	{
+		lookup_slice(0, n);
+		return;
+	}
+
+	std::vector<std::thread> workers;
+	workers.reserve(num_thread - 1);
+	const size_t slice = (n + num_thread - 1) / num_thread;
+	for (unsigned t = 1; t < num_thread; ++t)
+	{
+		workers.emplace_back(lookup_slice, std::min(n, t * slice), std::min(n, (t + 1) * slice));
+	}
+	lookup_slice(0, std::min(n, slice));
+	for (auto& w : workers)
+	{
+		w.join();
+	}
+}
+
+/// Map every key of a binary key file (as read by file_binary<Key>) to its id, written to output_ids_file as
+/// native uint64_t in input order; returns the number of keys
+/// The input is memory-mapped and processed in batches of batch_keys: while one batch is looked up on num_thread
+/// threads, the ids of the previous one are written out with a single large sequential write.
+template <typename Key, typename Hasher_t>
+uint64_t relabel(const mphf<Key, Hasher_t>& bphf, const std::string& input_keys_file,
+                 const std::string& output_ids_file, unsigned num_thread = 1, size_t batch_keys = 1 << 22)
+{
+	const file_binary<Key> keys(input_keys_file);
+	FILE* os = std::fopen(output_ids_file.c_str(), "wb");
+	if (!os)
+	{
+		throw std::invalid_argument("Error opening " + output_ids_file);
+	}
+
+	batch_keys = std::max<size_t>(batch_keys, 1);
+	std::vector<uint64_t> ids[2] = {std::vector<uint64_t>(std::min<size_t>(batch_keys, keys.size())),
+	                                std::vector<uint64_t>(std::min<size_t>(batch_keys, keys.size()))};
+	std::thread writer;
+	bool write_ok = true;
+
+	const size_t n = keys.size();
+	for (size_t begin = 0, batch = 0; begin < n; begin += batch_keys, ++batch)
+	{
+		const size_t count = std::min(batch_keys, n - begin);
+		std::vector<uint64_t>& out = ids[batch & 1];
+		relabel(bphf, keys.begin() + begin, count, out.data(), num_thread);
+
+		if (writer.joinable())
+		{
+			writer.join();
+		}
+		writer = std::thread([os, &out, count, &write_ok]()
+		                     { write_ok = write_ok && std::fwrite(out.data(), sizeof(uint64_t), count, os) == count; });
+	}
+	if (writer.joinable())
+	{
+		writer.join();
+	}
+
+	const bool close_ok = std::fclose(os) == 0;
+	if (!write_ok || !close_ok)
+	{
+		throw std::runtime_error("Error writing " + output_ids_file);
+	}
+	return n;
+}
+
+} // namespace boomphf
@@ -0,0 +1,371 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "bitvector.hpp"
+
+#if defined(_WIN32) || defined(_MSC_VER)
+#include "windows_sane.h" // For InterlockedCompareExchange64
+#endif
+
+namespace boomphf
+{
+
+namespace detail
+{
+
+/// For each byte of five base-3 slot states, the 5-bit masks of its slots holding one key and of its collided slots
+struct slot_state_tables
+{
+	std::array<uint8_t, 256> one{};
+	std::array<uint8_t, 256> many{};
+};
+
+constexpr slot_state_tables make_slot_state_tables()
+{
+	slot_state_tables t;
+	for (uint32_t b = 0; b < 243; ++b)
+	{
+		uint32_t v = b;
+		for (uint32_t d = 0; d < 5; ++d, v /= 3)
+		{
+			t.one[b] |= static_cast<uint8_t>((v % 3 == 1) << d);
+			t.many[b] |= static_cast<uint8_t>((v % 3 == 2) << d);
+		}
+	}
+	return t;
+}
+
+inline constexpr slot_state_tables SLOT_STATE_TABLES = make_slot_state_tables();
+
+} // namespace detail
+
+/**
+ * Insertion counts of the slots of a level under construction, saturating at two: empty, one key, collided
+ *
+ * Three states fit five slots per byte (3^5 = 243), so a level is built in 1.6 bits per slot instead of the level bit
+ * array plus a collision bit array of the same size (2 bits per slot). When the level is complete, to_bitvector()
+ * turns the buffer in place into the bit array of the slots holding exactly one key, optionally building its rank
+ * directory in the same pass, and shrinks it, so no second array is allocated unless the shrunk block moves.
+ */
+class slot_states
+{
+public:
+	/// Regions: at most MAX_REGIONS, each a whole number of words and at least MIN_REGION_SLOTS slots
+	static constexpr uint64_t MIN_REGION_SLOTS = 40 * 4096; // 32 KB of states
+	static constexpr uint64_t MAX_REGIONS = 1024;
+
+	explicit slot_states(uint64_t nslots)
+	    : _nslots(nslots), _nwords((64 * (1 + nslots / 64) + 5 * 8 - 1) / (5 * 8) + 1)
+	{
+		_words = bitVector::allocate_words(_nwords);
+		_region_slots = std::max(MIN_REGION_SLOTS, (nslots / MAX_REGIONS + 40) / 40 * 40);
+		_nregions = nslots / _region_slots + 1;
+		_region_locks = std::make_unique<std::mutex[]>(_nregions);
+	}
+
+	~slot_states() { std::free(_words); }
+
+	slot_states(const slot_states&) = delete;
+	slot_states& operator=(const slot_states&) = delete;
+
+	[[nodiscard]] uint64_t size() const noexcept { return _nslots; }
+	[[nodiscard]] uint64_t bitSize() const noexcept { return _nwords * 64; }
+
+	/// Count one more key in slot pos (thread-safe)
+	void insert(uint64_t pos) noexcept
+	{
+		const uint64_t byte = pos / 5;
+		const auto digit = static_cast<uint32_t>(pos % 5);
+		uint64_t* target = _words + byte / 8;
+		const uint32_t shift = 8 * (byte % 8);
+		uint64_t oldval;
+		uint64_t newval;
+#if defined(_WIN32) || defined(_MSC_VER)
+		do
+		{
+			oldval = static_cast<uint64_t>(InterlockedCompareExchange64((volatile LONG64*)target, 0, 0));
+			if ((detail::SLOT_STATE_TABLES.many[(oldval >> shift) & 0xff] >> digit) & 1)
+			{
+				return; // already collided
+			}
+			newval = oldval + (POW3[digit] << shift);
+		} while (InterlockedCompareExchange64((volatile LONG64*)target, (LONG64)newval, (LONG64)oldval) !=
+		         (LONG64)oldval);
+#else
+		oldval = __atomic_load_n(target, __ATOMIC_RELAXED);
+		do
+		{
+			if ((detail::SLOT_STATE_TABLES.many[(oldval >> shift) & 0xff] >> digit) & 1)
+			{
+				return; // already collided
+			}
+			newval = oldval + (POW3[digit] << shift);
+		} while (
+		    !__atomic_compare_exchange_n(target, &oldval, newval, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+#endif
+	}
+
+	[[nodiscard]] uint64_t regionSlots() const noexcept { return _region_slots; }
+	[[nodiscard]] uint64_t nbRegions() const noexcept { return _nregions; }
+
+	/// Count one more key in each slot region * regionSlots() + offsets[i]. Takes the region's lock once and then
+	/// writes without atomics, so batches of inserts into a region cost one lock instead of one CAS per key.
+	void insert_region(uint64_t region, const uint32_t* offsets, uint64_t count)
+	{
+		std::lock_guard<std::mutex> lock(_region_locks[region]);
+		const uint64_t base = region * _region_slots;
+		for (uint64_t i = 0; i < count; ++i)
+		{
+			const uint64_t pos = base + offsets[i];
+			const uint64_t byte = pos / 5;
+			const auto digit = static_cast<uint32_t>(pos % 5);
+			uint64_t& word = _words[byte / 8];
+			const uint32_t shift = 8 * (byte % 8);
+			if (!((detail::SLOT_STATE_TABLES.many[(word >> shift) & 0xff] >> digit) & 1))
+			{
+				word += POW3[digit] << shift;
+			}
+		}
+	}
+
+	/// Start loading the word holding slot pos, for an insert
+	void prefetch(uint64_t pos) const noexcept { prefetch_write(_words + pos / 40); }
+
+	/// 0 (empty), 1 (one key) or 2 (collided)
+	[[nodiscard]] uint32_t state(uint64_t pos) const noexcept
+	{
+		const uint8_t b = byte_at(pos / 5);
+		const auto digit = static_cast<uint32_t>(pos % 5);
+		const auto& tables = detail::SLOT_STATE_TABLES;
+		return ((tables.one[b] >> digit) & 1) | (((tables.many[b] >> digit) & 1) << 1);
+	}
+
+	/// The bit array of the slots holding exactly one key, built in place in this buffer, which is consumed.
+	/// Output word k only overwrites slots already read, so the words are converted front to back: serially up to
+	/// SERIAL_WORDS, then in rounds [x, 8x / 5) whose outputs do not overlap their inputs, split over nthreads.
+	[[nodiscard]] bitVector to_bitvector(uint32_t nthreads = 1) &&
+	{
+		uint64_t offset = 0;
+		return std::move(*this).to_bitvector(offset, 0, nthreads);
+	}
+
+	/// As above, with the rank directory of block_bits bits blocks (see bitVector::build_ranks) counted from offset
+	/// while the words are produced, instead of in a second pass over the bit array. offset is advanced by the number
+	/// of slots holding one key. With block_bits 0 no ranks are built and offset is left as is.
+	[[nodiscard]] bitVector to_bitvector(uint64_t& offset, uint64_t block_bits, uint32_t nthreads = 1) &&
+	{
+		if (block_bits != 0 && !bitVector::valid_rank_block_bits(block_bits))
+		{
+			throw std::invalid_argument("rank block size must be a power of two between 64 and 4096 bits");
+		}
+		const uint64_t nchar = 1 + _nslots / 64;
+		const uint64_t words_per_block = block_bits / 64;
+		const uint64_t nsuper = (nchar + WORDS_PER_SUPER - 1) / WORDS_PER_SUPER;
+		std::vector<uint16_t> block_ranks(words_per_block != 0 ? (nchar + words_per_block - 1) / words_per_block : 0);
+		std::vector<uint64_t> counts(words_per_block != 0 ? nsuper : 0);
+		const rank_output ranks{words_per_block, block_ranks.data(), counts.data()};
+
+		// Rounds and thread shares start on superblocks, whose block ranks are relative to their first word
+		uint64_t x = std::min(nchar, SERIAL_WORDS);
+		compact(0, x, ranks);
+		while (x < nchar)
+		{
+			const uint64_t y = std::min(nchar, 8 * x / 5 / WORDS_PER_SUPER * WORDS_PER_SUPER);
+			const uint64_t nthr = std::max<uint64_t>(1, std::min<uint64_t>(nthreads, (y - x) / SERIAL_WORDS));
+			if (nthr > 1)
+			{
+				const uint64_t supers = (y - x + WORDS_PER_SUPER - 1) / WORDS_PER_SUPER;
+				auto bound = [x, y, supers, nthr](uint64_t t)
+				{ return std::min(y, x + supers * t / nthr * WORDS_PER_SUPER); };
+				std::vector<std::thread> threads;
+				threads.reserve(nthr);
+				for (uint64_t t = 0; t < nthr; ++t)
+				{
+					threads.emplace_back([this, &ranks, &bound, t] { compact(bound(t), bound(t + 1), ranks); });
+				}
+				for (auto& t : threads)
+				{
+					t.join();
+				}
+			}
+			else
+			{
+				compact(x, y, ranks);
+			}
+			x = y;
+		}
+
+		// Give back the tail; a failed shrink leaves the larger block valid. realloc only keeps the fundamental
+		// alignment, so a block moved off a cache line is copied back to one (bitVector::CACHE_LINE_BYTES).
+		if (auto* shrunk = static_cast<uint64_t*>(std::realloc(_words, nchar * sizeof(uint64_t))))
+		{
+			_words = shrunk;
+		}
+#if !defined(_MSC_VER)
+		if (reinterpret_cast<std::uintptr_t>(_words) % bitVector::CACHE_LINE_BYTES != 0)
+		{
+			uint64_t* aligned = bitVector::allocate_words(nchar);
+			std::memcpy(aligned, _words, nchar * sizeof(uint64_t));
+			std::free(_words);
+			_words = aligned;
+		}
+#endif
+		bitVector result(_nslots, _words);
+		_words = nullptr;
+		_nslots = 0;
+		_nwords = 0;
+
+		if (words_per_block != 0)
+		{
+			result.set_rank_block_bits(block_bits);
+			result._block_ranks = std::move(block_ranks);
+			result._super_ranks.reserve(nsuper);
+			for (const uint64_t count : counts)
+			{
+				result._super_ranks.push_back(offset);
+				offset += count;
+			}
+		}
+		return result;
+	}
+
+private:
+	static constexpr uint64_t SERIAL_WORDS = 1ULL << 14;
+	static constexpr uint64_t WORDS_PER_SUPER = bitVector::SUPERBLOCK_BITS / 64;
+	static constexpr std::array<uint64_t, 5> POW3{1, 3, 9, 27, 81};
+
+	/// Where compact() writes the rank directory: nothing when words_per_block is 0
+	struct rank_output
+	{
+		uint64_t words_per_block;
+		uint16_t* block_ranks; // relative to the superblock
+		uint64_t* counts;      // set bits per superblock
+	};
+
+	[[nodiscard]] uint8_t byte_at(uint64_t byte) const noexcept
+	{
+		return static_cast<uint8_t>(_words[byte / 8] >> (8 * (byte % 8)));
+	}
+
+	/// Writes output words [first, last): bit i of word k is set when slot 64 * k + i holds one key. With ranks, first
+	/// is the start of a superblock and the ranks of the words written are filled in.
+	void compact(uint64_t first, uint64_t last, const rank_output& ranks) noexcept
+	{
+		if (first >= last)
+		{
+			return;
+		}
+		const uint64_t block_mask = ranks.words_per_block - 1;
+		uint64_t count = 0;
+		uint64_t byte = first * 64 / 5;
+		const auto skip = static_cast<uint32_t>(first * 64 % 5);
+		uint64_t carry = detail::SLOT_STATE_TABLES.one[byte_at(byte++)] >> skip;
+		uint32_t ncarry = 5 - skip;
+		for (uint64_t k = first; k < last; ++k)
+		{
+			uint64_t word = carry;
+			uint32_t n = ncarry;
+			for (;;)
+			{
+				const uint64_t m = detail::SLOT_STATE_TABLES.one[byte_at(byte++)];
+				word |= m << n;
+				if (n + 5 >= 64)
+				{
+					carry = n + 5 == 64 ? 0 : m >> (64 - n);
+					ncarry = n + 5 - 64;
+					break;
+				}
+				n += 5;
+			}
+			_words[k] = word;
+
+			if (ranks.words_per_block != 0)
+			{
+				if (k % WORDS_PER_SUPER == 0)
+				{
+					count = 0;
+				}
+				if ((k & block_mask) == 0)
+				{
+					ranks.block_ranks[k / ranks.words_per_block] = static_cast<uint16_t>(count);
+				}
+				count += popcount_64(word);
+				if ((k + 1) % WORDS_PER_SUPER == 0 || k + 1 == last)
+				{
+					ranks.counts[k / WORDS_PER_SUPER] = count;
+				}
+			}
+		}
+	}
+
+	uint64_t* _words{nullptr};
+	uint64_t _nslots{0};
+	uint64_t _nwords{0};
+	uint64_t _region_slots{MIN_REGION_SLOTS};
+	uint64_t _nregions{1};
+	std::unique_ptr<std::mutex[]> _region_locks;
+};
+
+/**
+ * One thread's inserts into a slot_states, bucketed by region and applied a bucket at a time
+ *
+ * Inserting keys in hash order hits a random word of the level for every key: on large levels nearly every insert
+ * misses the cache and the TLB, and with several threads the CAS bounces cache lines between cores. Here positions
+ * wait in a small buffer per region; a full buffer is applied in one go with plain writes to a region that fits in
+ * cache (see slot_states::insert_region). flush() must be called once the thread is done inserting.
+ */
+class slot_region_buffer
+{
+public:
+	static constexpr uint64_t BUCKET_SIZE = 256;
+
+	explicit slot_region_buffer(slot_states& slots)
+	    : _slots(slots), _offsets(slots.nbRegions() * BUCKET_SIZE), _fill(slots.nbRegions())
+	{
+	}
+
+	slot_region_buffer(const slot_region_buffer&) = delete;
+	slot_region_buffer& operator=(const slot_region_buffer&) = delete;
+
+	void insert(uint64_t pos)
+	{
+		const uint64_t region = pos / _slots.regionSlots();
+		uint32_t& fill = _fill[region];
+		_offsets[region * BUCKET_SIZE + fill] = static_cast<uint32_t>(pos - region * _slots.regionSlots());
+		if (++fill == BUCKET_SIZE)
+		{
+			_slots.insert_region(region, &_offsets[region * BUCKET_SIZE], fill);
+			fill = 0;
+		}
+	}
+
+	/// Apply every buffered insert
+	void flush()
+	{
+		for (uint64_t region = 0; region < _fill.size(); ++region)
+		{
+			if (_fill[region] != 0)
+			{
+				_slots.insert_region(region, &_offsets[region * BUCKET_SIZE], _fill[region]);
+				_fill[region] = 0;
+			}
+		}
+	}
+
+private:
+	slot_states& _slots;
+	std::vector<uint32_t> _offsets; // BUCKET_SIZE per region
+	std::vector<uint32_t> _fill;
+};
+
+} // namespace boomphf
@@ -0,0 +1,337 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "endian_utils.hpp"
+#include "key_traits.hpp"
+
+namespace boomphf
+{
+
+namespace detail
+{
+
+/// Read-only std::istream over a block of memory (e.g. part of a memory-mapped file), without copying it
+class memory_streambuf : public std::streambuf
+{
+public:
+	memory_streambuf(const char* data, size_t size)
+	{
+		char* p = const_cast<char*>(data); // the get area is never written through
+		setg(p, p, p + size);
+	}
+};
+
+/// Zero bytes that bring a section of the given size to a multiple of 8 bytes
+inline void write_padding(std::ostream& os, uint64_t section_bytes)
+{
+	static const char zeros[8] = {};
+	os.write(zeros, static_cast<std::streamsize>((8 - section_bytes % 8) % 8));
+}
+
+inline void skip_padding(std::istream& is, uint64_t section_bytes)
+{
+	is.ignore(static_cast<std::streamsize>((8 - section_bytes % 8) % 8));
+}
+
+/// Bounds-checked cursor over a memory-mapped file made of 8-byte aligned sections
+class mapped_cursor
+{
+public:
+	mapped_cursor(const char* data, size_t size) : _p(data), _end(data + size) {}
+
+	[[nodiscard]] const char* take(uint64_t bytes)
+	{
+		if (bytes > static_cast<uint64_t>(_end - _p))
+		{
+			throw std::runtime_error("Truncated memory-mapped file");
+		}
+		const char* p = _p;
+		_p += bytes;
+		return p;
+	}
+
+	/// Take a section and skip the padding that follows it
+	[[nodiscard]] const char* take_section(uint64_t bytes)
+	{
+		const char* p = take(bytes);
+		[[maybe_unused]] auto pad = take((8 - bytes % 8) % 8);
+		return p;
+	}
+
+	template <typename T> [[nodiscard]] T read()
+	{
+		T v;
+		std::memcpy(&v, take(sizeof(T)), sizeof(T));
+		return from_little_endian(v);
+	}
+
+private:
+	const char* _p;
+	const char* _end;
+};
+
+} // namespace detail
+
+/// Keys stored by slot (e.g. in MPHF order), owned or viewed in place from a memory-mapped file
+/// Fixed-size keys are kept as a plain array in little-endian layout; variable-length keys (strings) as n + 1 offsets
+/// followed by their bytes. Serialized layout: count (u64), payload bytes (u64), payload, zero padding to 8 bytes.
+template <typename Key> class stored_keys
+{
+	using traits = key_traits<Key>;
+	static constexpr bool variable_length = traits::variable_length;
+	static_assert(variable_length || std::is_trivially_copyable_v<typename traits::value_type>,
+	              "stored keys must be trivially copyable or variable-length byte strings");
+
+public:
+	using key_value_t = typename traits::value_type;
+	using key_view_t = typename traits::view_type;
+
+	stored_keys() { point_to_owned(); }
+
+	stored_keys(const stored_keys& r) : _fixed(r._fixed), _offsets(r._offsets), _bytes(r._bytes) { rebase(r); }
+
+	stored_keys& operator=(const stored_keys& r)
+	{
+		if (this != &r)
+		{
+			_fixed = r._fixed;
+			_offsets = r._offsets;
+			_bytes = r._bytes;
+			rebase(r);
+		}
+		return *this;
+	}
+
+	stored_keys(stored_keys&& r) noexcept { *this = std::move(r); }
+
+	stored_keys& operator=(stored_keys&& r) noexcept
+	{
+		if (this != &r)
+		{
+			_fixed = std::move(r._fixed);
+			_offsets = std::move(r._offsets);
+			_bytes = std::move(r._bytes);
+			rebase(r);
+
+			r._fixed.clear();
+			r._offsets.clear();
+			r._bytes.clear();
+			r._size = 0;
+			r._view = false;
+			r.point_to_owned();
+		}
+		return *this;
+	}
+
+	/// Take ownership of keys already laid out by slot
+	void assign(std::vector<key_value_t>&& keys)
+	{
+		_view = false;
+		_size = keys.size();
+		if constexpr (variable_length)
+		{
+			_offsets.assign(1, 0);
+			_offsets.reserve(keys.size() + 1);
+			_bytes.clear();
+			for (const auto& k : keys)
+			{
+				_bytes.append(k);
+				_offsets.push_back(to_little_endian(static_cast<uint64_t>(_bytes.size())));
+			}
+			std::vector<key_value_t>().swap(keys);
+		}
+		else
+		{
+			_fixed = std::move(keys);
+		}
+		point_to_owned();
+	}
+
+	[[nodiscard]] uint64_t size() const noexcept { return _size; }
+
+	[[nodiscard]] key_view_t at(uint64_t i) const
+	{
+		if constexpr (variable_length)
+		{
+			const uint64_t begin = from_little_endian(_offsets_data[i]);
+			const uint64_t end = from_little_endian(_offsets_data[i + 1]);
+			return key_view_t(_bytes_data + begin, end - begin);
+		}
+		else if (_view)
+		{
+			key_value_t k;
+			std::memcpy(&k, _fixed_data + i * sizeof(key_value_t), sizeof(k));
+			return k;
+		}
+		else
+		{
+			return _fixed[i];
+		}
+	}
+
+	[[nodiscard]] uint64_t bitSize() const noexcept { return payload_bytes() * 8; }
+
+	void save(std::ostream& os) const
+	{
+		write_le(os, _size);
+		write_le(os, payload_bytes());
+		if constexpr (variable_length)
+		{
+			os.write(reinterpret_cast<const char*>(_offsets_data), static_cast<std::streamsize>((_size + 1) * 8));
+			os.write(_bytes_data, static_cast<std::streamsize>(string_bytes()));
+		}
+		else if (is_system_little_endian())
+		{
+			os.write(_fixed_data, static_cast<std::streamsize>(_size * sizeof(key_value_t)));
+		}
+		else
+		{
+			for (uint64_t i = 0; i < _size; ++i)
+			{
+				traits::write(os, at(i));
+			}
+		}
+		detail::write_padding(os, payload_bytes());
+	}
+
+	void load(std::istream& is)
+	{
+		uint64_t n, bytes;
+		read_le(is, n);
+		read_le(is, bytes);
+		// Sizes are checked before anything is allocated from them
+		const bool consistent = variable_length ? n < bytes / 8
+		                                        : n <= bytes / sizeof(key_value_t) && bytes == n * sizeof(key_value_t);
+		if (!is || !consistent)
+		{
+			throw std::runtime_error("Corrupted stored keys section");
+		}
+		_view = false;
+		_size = n;
+		if constexpr (variable_length)
+		{
+			_offsets.resize(n + 1);
+			is.read(reinterpret_cast<char*>(_offsets.data()), static_cast<std::streamsize>((n + 1) * 8));
+			_bytes.resize(bytes - (n + 1) * 8);
+			is.read(_bytes.data(), static_cast<std::streamsize>(_bytes.size()));
+		}
+		else
+		{
+			_fixed.resize(n);
+			for (auto& k : _fixed)
+			{
+				traits::read(is, k);
+			}
+		}
+		if (!is)
+		{
+			throw std::runtime_error("Corrupted stored keys section");
+		}
+		detail::skip_padding(is, bytes);
+		point_to_owned();
+	}
+
+	/// Point at a serialized section of a memory-mapped file instead of copying it (little-endian hosts only)
+	void map(detail::mapped_cursor& cursor)
+	{
+		_fixed.clear();
+		_offsets.clear();
+		_bytes.clear();
+		_view = true;
+		_size = cursor.read<uint64_t>();
+		const uint64_t bytes = cursor.read<uint64_t>();
+		const char* payload = cursor.take_section(bytes);
+		if constexpr (variable_length)
+		{
+			if (bytes < (_size + 1) * 8)
+			{
+				throw std::runtime_error("Corrupted stored keys section");
+			}
+			_offsets_data = reinterpret_cast<const uint64_t*>(payload);
+			_bytes_data = payload + (_size + 1) * 8;
+		}
+		else
+		{
+			if (bytes != _size * sizeof(key_value_t))
+			{
+				throw std::runtime_error("Corrupted stored keys section");
+			}
+			_fixed_data = payload;
+		}
+	}
+
+private:
+	[[nodiscard]] uint64_t string_bytes() const noexcept
+	{
+		return _size == 0 && !_offsets_data ? 0 : from_little_endian(_offsets_data[_size]);
+	}
+
+	[[nodiscard]] uint64_t payload_bytes() const noexcept
+	{
+		if constexpr (variable_length)
+		{
+			return (_size + 1) * 8 + string_bytes();
+		}
+		else
+		{
+			return _size * sizeof(key_value_t);
+		}
+	}
+
+	void point_to_owned()
+	{
+		if constexpr (variable_length)
+		{
+			if (_offsets.empty())
+			{
+				_offsets.assign(1, 0);
+			}
+			_offsets_data = _offsets.data();
+			_bytes_data = _bytes.data();
+		}
+		else
+		{
+			_fixed_data = reinterpret_cast<const char*>(_fixed.data());
+		}
+	}
+
+	void rebase(const stored_keys& r)
+	{
+		_view = r._view;
+		_size = r._size;
+		if (_view)
+		{
+			_fixed_data = r._fixed_data;
+			_offsets_data = r._offsets_data;
+			_bytes_data = r._bytes_data;
+		}
+		else
+		{
+			point_to_owned();
+		}
+	}
+
+	// Owned storage (empty for views)
+	std::vector<key_value_t> _fixed;
+	std::vector<uint64_t> _offsets; // little-endian
+	std::string _bytes;
+
+	// What the accessors read, either the owned storage or the mapping
+	const char* _fixed_data{nullptr};
+	const uint64_t* _offsets_data{nullptr};
+	const char* _bytes_data{nullptr};
+	uint64_t _size{0};
+	bool _view{false};
+};
+
+} // namespace boomphf
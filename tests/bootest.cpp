@@ -432,6 +432,7 @@ int main(int argc, char* argv[])
 	bool from_disk = true;
 	bool bench_lookup_out = false;
 	bool on_the_fly = false;
+	uint32_t fingerprint_bits = 0;
 	write_each = true;
 	if (argc < 4)
 	{
@@ -446,6 +447,7 @@ int main(int argc, char* argv[])
 		printf("\t-nodisk  (do not write each intermediate level on disk)\n");
 		printf("\t-buckets\n");
 		printf("\t-outquery (bench the fp rate of the mphf)\n"); // bench fp rate
+		printf("\t-fingerprint <bits>  (store 1 to 16 bits per key to reject out of set queries)\n");
 		printf("\t-onthefly (generates key on the fly without storing them on disk or in ram)\n");
 
 		return EXIT_FAILURE;
@@ -478,6 +480,8 @@ int main(int argc, char* argv[])
 			on_the_fly = true;
 		if (!strcmp("-nodisk", argv[ii]))
 			write_each = false;
+		if (!strcmp("-fingerprint", argv[ii]) && ii + 1 < argc)
+			fingerprint_bits = static_cast<uint32_t>(atoi(argv[++ii]));
 	}
 
 	if (gammaFactor == 0)
@@ -770,17 +774,23 @@ int main(int argc, char* argv[])
 		{
 			auto data_iterator = uint64_range(nelem, nelem);
 			bphf = new boomphf::mphf<uint64_t, hasher_t>(nelem, data_iterator, nthreads, gammaFactor, write_each);
+			if (fingerprint_bits)
+				bphf->addFingerprints(data_iterator, fingerprint_bits, nthreads);
 		}
 		else if (from_disk)
 		{
 			auto data_iterator = file_binary("keyfile");
 			bphf = new boomphf::mphf<uint64_t, hasher_t>(nelem, data_iterator, nthreads, gammaFactor, write_each);
+			if (fingerprint_bits)
+				bphf->addFingerprints(data_iterator, fingerprint_bits, nthreads);
 		}
 		else
 		{
 			auto data_iterator =
 			    boomphf::range(static_cast<const uint64_t*>(data), static_cast<const uint64_t*>(data + nelem));
 			bphf = new boomphf::mphf<uint64_t, hasher_t>(nelem, data_iterator, nthreads, gammaFactor, write_each);
+			if (fingerprint_bits)
+				bphf->addFingerprints(data_iterator, fingerprint_bits, nthreads);
 		}
 
 		auto t_end = std::chrono::high_resolution_clock::now();
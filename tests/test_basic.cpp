@@ -1,6 +1,11 @@
 #include "BooPHF.h"
 #include "catch2/catch.hpp"
 #include <algorithm>
+#include <array>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <string_view>
 #include <vector>
 
 typedef boomphf::SingleHashFunctor<uint64_t> hasher_t;
@@ -147,3 +152,641 @@ TEST_CASE("MPHF with writeEachLevel enabled", "[writeEachLevel]")
 		}
 	}
 }
+
+TEST_CASE("MPHF with user seed", "[seed]")
+{
+	std::vector<uint64_t> data;
+	for (uint64_t i = 0; i < 5000; i++)
+	{
+		data.push_back(i);
+	}
+
+	SECTION("Seed is applied and reported")
+	{
+		boomphf::mphf_options options;
+		options.seed = 12345;
+		boophf_t bphf(data.size(), data, 1, 2.0, false, false, 0.03f, options);
+		REQUIRE(bphf.seed() == 12345);
+
+		std::vector<uint64_t> indices;
+		for (const auto& key : data)
+		{
+			indices.push_back(bphf.lookup(key));
+		}
+		std::sort(indices.begin(), indices.end());
+		REQUIRE(std::unique(indices.begin(), indices.end()) == indices.end());
+		REQUIRE(indices.back() < data.size());
+	}
+
+	SECTION("Duplicated keys trigger seed retries")
+	{
+		// Duplicates collide at every level and always land in the fallback table
+		std::vector<uint64_t> dup_data(data);
+		dup_data.insert(dup_data.end(), data.begin(), data.begin() + 200);
+
+		boomphf::mphf_options options;
+		options.seed = 7;
+		options.seed_retries = 2;
+		boophf_t bphf(dup_data.size(), dup_data, 1, 2.0, false, false, 0.03f, options);
+		REQUIRE(bphf.nbFallbackKeys() > bphf.fallbackThreshold());
+		REQUIRE(bphf.seed() != 7);
+	}
+}
+
+TEMPLATE_TEST_CASE("MPHF with fast hashers", "[hashers]", boomphf::Murmur3Hasher<uint64_t>,
+                   boomphf::WyHasher<uint64_t>, boomphf::Crc32cHasher<uint64_t>)
+{
+	std::vector<uint64_t> data;
+	for (uint64_t i = 0; i < 10000; i++)
+	{
+		data.push_back(i * 11);
+	}
+
+	boomphf::mphf<uint64_t, TestType> bphf(data.size(), data, 1, 2.0, false, false);
+
+	std::vector<uint64_t> indices;
+	for (const auto& key : data)
+	{
+		indices.push_back(bphf.lookup(key));
+	}
+	std::sort(indices.begin(), indices.end());
+	REQUIRE(std::unique(indices.begin(), indices.end()) == indices.end());
+	REQUIRE(indices.back() < data.size());
+}
+
+// Returns both base hashes from a single pass over the key
+struct PairHasher
+{
+	boomphf::hash_pair_t operator()(uint64_t key, uint64_t seed) const
+	{
+		const uint64_t h = boomphf::fmix64(key ^ seed);
+		return {h, boomphf::fmix64(h ^ 0x33333333CCCCCCCCULL)};
+	}
+};
+
+#if defined(__SIZEOF_INT128__)
+struct Pair128Hasher
+{
+	__uint128_t operator()(uint64_t key, uint64_t seed) const
+	{
+		return static_cast<__uint128_t>(boomphf::fmix64(key ^ seed)) * 0x9E3779B97F4A7C15ULL + key;
+	}
+};
+#endif
+
+TEST_CASE("MPHF with hashers returning two hashes per call", "[hashers][pair]")
+{
+	static_assert(boomphf::is_pair_hasher_v<uint64_t, PairHasher>);
+	static_assert(!boomphf::is_pair_hasher_v<uint64_t, hasher_t>);
+
+	std::vector<uint64_t> data;
+	for (uint64_t i = 0; i < 20000; i++)
+	{
+		data.push_back(i * 13);
+	}
+
+	auto check = [&data](const auto& bphf)
+	{
+		std::vector<uint64_t> indices;
+		for (const auto& key : data)
+		{
+			indices.push_back(bphf.lookup(key));
+		}
+		std::sort(indices.begin(), indices.end());
+		REQUIRE(std::unique(indices.begin(), indices.end()) == indices.end());
+		REQUIRE(indices.back() < data.size());
+	};
+
+	SECTION("hash_pair_t result")
+	{
+		boomphf::mphf<uint64_t, PairHasher> bphf(data.size(), data, 1, 1.0, false, false);
+		check(bphf);
+	}
+
+#if defined(__SIZEOF_INT128__)
+	SECTION("128-bit result")
+	{
+		boomphf::mphf<uint64_t, Pair128Hasher> bphf(data.size(), data, 1, 1.0, true, false);
+		check(bphf);
+	}
+#endif
+}
+
+TEST_CASE("MPHF with string keys", "[strings]")
+{
+	std::vector<std::string> data;
+	for (uint64_t i = 0; i < 30000; i++)
+	{
+		data.push_back("https://example.com/" + std::to_string(i * 31) + (i % 3 ? "/index.html" : ""));
+	}
+	data.push_back("");
+
+	auto check = [&data](const auto& bphf)
+	{
+		std::vector<uint64_t> indices;
+		for (const auto& key : data)
+		{
+			const uint64_t idx = bphf.lookup(std::string_view(key));
+			REQUIRE(idx == bphf.lookup(key));
+			indices.push_back(idx);
+		}
+		std::sort(indices.begin(), indices.end());
+		REQUIRE(std::unique(indices.begin(), indices.end()) == indices.end());
+		REQUIRE(indices.back() < data.size());
+	};
+
+	SECTION("Fast mode")
+	{
+		boomphf::mphf<std::string, boomphf::StringHasher> bphf(data.size(), data, 2, 1.0, false, false);
+		check(bphf);
+	}
+
+	SECTION("writeEachLevel spill files")
+	{
+		boomphf::mphf<std::string, boomphf::StringHasher> bphf(data.size(), data, 2, 1.0, true, false);
+		check(bphf);
+	}
+
+	SECTION("std::string_view input")
+	{
+		std::vector<std::string_view> views(data.begin(), data.end());
+		boomphf::mphf<std::string_view, boomphf::StringHasher> bphf(views.size(), views, 1, 2.0, false, false);
+		check(bphf);
+	}
+}
+
+TEST_CASE("MPHF with 128-bit keys", "[wide]")
+{
+	using key128_t = std::array<uint64_t, 2>;
+
+	// Structured keys: consecutive k-mer-like values that only differ in the high word for half of them
+	std::vector<key128_t> data;
+	for (uint64_t i = 0; i < 20000; i++)
+	{
+		data.push_back({i, i % 2 ? 0x0123456789ABCDEFULL : 0});
+	}
+
+	SECTION("std::array<uint64_t, 2> keys")
+	{
+		boomphf::mphf<key128_t, boomphf::Hasher128<key128_t>> bphf(data.size(), data, 2, 1.0, true, false);
+
+		std::vector<uint64_t> indices;
+		for (const auto& key : data)
+		{
+			indices.push_back(bphf.lookup(key));
+		}
+		std::sort(indices.begin(), indices.end());
+		REQUIRE(std::unique(indices.begin(), indices.end()) == indices.end());
+		REQUIRE(indices.back() < data.size());
+	}
+
+#if defined(__SIZEOF_INT128__)
+	SECTION("__uint128_t keys read from a binary file")
+	{
+		const char* filename = "test_keys128.bin";
+		{
+			FILE* f = std::fopen(filename, "wb");
+			REQUIRE(f != nullptr);
+			for (const auto& key : data)
+			{
+				const __uint128_t k = (static_cast<__uint128_t>(key[1]) << 64) | key[0];
+				std::fwrite(&k, sizeof(k), 1, f);
+			}
+			std::fclose(f);
+		}
+
+		{
+			boomphf::file_binary<__uint128_t> keys(filename);
+			boomphf::mphf<__uint128_t, boomphf::Hasher128<__uint128_t>> bphf(data.size(), keys, 1, 2.0, false,
+			                                                                  false);
+
+			// Both key representations hash identically
+			boomphf::mphf<key128_t, boomphf::Hasher128<key128_t>> bphf_array(data.size(), data, 1, 2.0, false,
+			                                                                  false);
+
+			std::vector<uint64_t> indices;
+			for (const auto& key : data)
+			{
+				const __uint128_t k = (static_cast<__uint128_t>(key[1]) << 64) | key[0];
+				REQUIRE(bphf.lookup(k) == bphf_array.lookup(key));
+				indices.push_back(bphf.lookup(k));
+			}
+			std::sort(indices.begin(), indices.end());
+			REQUIRE(std::unique(indices.begin(), indices.end()) == indices.end());
+			REQUIRE(indices.back() < data.size());
+		}
+
+		std::remove(filename);
+	}
+#endif
+}
+
+TEST_CASE("MPHF with digest keys", "[digest]")
+{
+	// SHA-1 sized digests of uniformly random bytes, used as-is by DigestHasher
+	using digest20_t = boomphf::digest_t<20>;
+	std::mt19937_64 rng(7);
+	std::vector<digest20_t> data(20000);
+	for (auto& d : data)
+	{
+		for (auto& b : d)
+		{
+			b = static_cast<uint8_t>(rng());
+		}
+	}
+
+	for (bool writeEach : {false, true})
+	{
+		boomphf::mphf<digest20_t, boomphf::DigestHasher<digest20_t>> bphf(data.size(), data, 2, 1.0, writeEach,
+		                                                                  false);
+
+		std::vector<uint64_t> indices;
+		for (const auto& key : data)
+		{
+			indices.push_back(bphf.lookup(key));
+		}
+		std::sort(indices.begin(), indices.end());
+		REQUIRE(std::unique(indices.begin(), indices.end()) == indices.end());
+		REQUIRE(indices.back() < data.size());
+	}
+}
+
+TEST_CASE("MPHF with fingerprints", "[fingerprint]")
+{
+	std::mt19937_64 rng(11);
+	std::vector<uint64_t> data(50000);
+	for (auto& key : data)
+	{
+		key = rng() | 1; // queries below are even
+	}
+	std::sort(data.begin(), data.end());
+	data.erase(std::unique(data.begin(), data.end()), data.end());
+
+	boophf_t bphf(data.size(), data, 1, 2.0, false, false);
+	REQUIRE(bphf.fingerprintBits() == 0);
+	REQUIRE_THROWS_AS(bphf.addFingerprints(data, 17), std::invalid_argument);
+
+	for (uint32_t bits : {1u, 8u, 16u})
+	{
+		bphf.addFingerprints(data, bits, 2);
+		REQUIRE(bphf.fingerprintBits() == bits);
+
+		std::vector<uint64_t> indices;
+		for (const auto key : data)
+		{
+			indices.push_back(bphf.lookup(key));
+		}
+		std::sort(indices.begin(), indices.end());
+		REQUIRE(std::unique(indices.begin(), indices.end()) == indices.end());
+		REQUIRE(indices.back() < data.size());
+
+		const uint64_t nqueries = 200000;
+		uint64_t false_positives = 0;
+		for (uint64_t i = 0; i < nqueries; ++i)
+		{
+			false_positives += bphf.lookup(rng() & ~1ULL) != ULLONG_MAX;
+		}
+		const double expected = 1.0 / static_cast<double>(1ULL << bits);
+		REQUIRE(static_cast<double>(false_positives) / nqueries < 1.5 * expected + 0.001);
+	}
+}
+
+TEST_CASE("Non-minimal MPHF without ranks", "[non-minimal]")
+{
+	std::vector<uint64_t> data;
+	for (uint64_t i = 0; i < 30000; i++)
+	{
+		data.push_back(i * 0x9E3779B97F4A7C15ULL);
+	}
+	// A duplicate always reaches the fallback level, whose ids follow the used level positions
+	data.push_back(data[5]);
+
+	boomphf::mphf_options options;
+	options.minimal = false;
+	for (double gamma : {1.0, 2.0})
+	{
+		boophf_t bphf(data.size(), data, 2, gamma, false, false, 0.03f, options);
+		REQUIRE_FALSE(bphf.isMinimal());
+		REQUIRE(bphf.nbFallbackKeys() == 1);
+		REQUIRE(bphf.hashRange() >= data.size());
+		REQUIRE(bphf.hashRange() < static_cast<uint64_t>(4 * gamma * data.size()));
+
+		std::vector<uint64_t> indices;
+		for (size_t i = 0; i + 1 < data.size(); ++i)
+		{
+			indices.push_back(bphf.lookup(data[i]));
+		}
+		std::sort(indices.begin(), indices.end());
+		REQUIRE(std::unique(indices.begin(), indices.end()) == indices.end());
+		REQUIRE(indices.back() < bphf.hashRange());
+
+		bphf.addFingerprints(data, 8);
+		for (const auto key : data)
+		{
+			REQUIRE(bphf.lookup(key) < bphf.hashRange());
+		}
+	}
+}
+
+TEST_CASE("Elias-Fano sets answer get and rank like the bit array", "[elias_fano]")
+{
+	std::mt19937_64 rng(3);
+	for (uint64_t size : {64ULL, 1000ULL, 100000ULL})
+	{
+		for (uint64_t one_in : {1ULL, 3ULL, 50ULL, 5000ULL})
+		{
+			boomphf::bitVector bv(size);
+			for (uint64_t i = 0; i < size; ++i)
+			{
+				if (rng() % one_in == 0)
+				{
+					bv.set(i);
+				}
+			}
+			const uint64_t base = bv.build_ranks(17);
+			const boomphf::elias_fano ef(bv, 17);
+			REQUIRE(ef.count() == base - 17);
+			for (uint64_t i = 0; i < size; ++i)
+			{
+				REQUIRE(ef.get(i) == bv.get(i));
+				REQUIRE(ef.rank(i) == bv.rank(i));
+			}
+		}
+	}
+}
+
+TEST_CASE("MPHF with compressed deep levels", "[elias_fano]")
+{
+	std::vector<uint64_t> data;
+	for (uint64_t i = 0; i < 100000; i++)
+	{
+		data.push_back(i * 0x9E3779B97F4A7C15ULL + 12345);
+	}
+
+	for (bool minimal : {true, false})
+	{
+		boomphf::mphf_options options;
+		options.minimal = minimal;
+		for (double gamma : {2.0, 5.0})
+		{
+			boophf_t bphf(data.size(), data, 1, gamma, false, false, 0.03f, options);
+			std::vector<uint64_t> before;
+			for (const auto key : data)
+			{
+				before.push_back(bphf.lookup(key));
+			}
+
+			const uint32_t ncompressed = bphf.compressLevels(1);
+			if (gamma > 2.0)
+			{
+				REQUIRE(ncompressed > 0); // levels are sparse enough for Elias-Fano to win
+			}
+			for (size_t i = 0; i < data.size(); ++i)
+			{
+				REQUIRE(bphf.lookup(data[i]) == before[i]);
+			}
+		}
+	}
+}
+
+TEST_CASE("Rank directory with configurable block size", "[rank]")
+{
+	std::mt19937_64 rng(9);
+	const uint64_t size = 3 * boomphf::bitVector::SUPERBLOCK_BITS + 1000; // spans several superblocks
+	boomphf::bitVector bv(size);
+	for (uint64_t i = 0; i < size; ++i)
+	{
+		if (rng() % 3 == 0)
+		{
+			bv.set(i);
+		}
+	}
+
+	for (uint64_t block_bits : {64ULL, 128ULL, 512ULL, 4096ULL})
+	{
+		const uint64_t total = bv.build_ranks(100, block_bits);
+		REQUIRE(bv.rankBlockBits() == block_bits);
+		uint64_t expected = 100;
+		for (uint64_t i = 0; i < size; ++i)
+		{
+			REQUIRE(bv.rank(i) == expected);
+			expected += bv.get(i);
+		}
+		REQUIRE(total == expected);
+	}
+	REQUIRE_THROWS_AS(bv.build_ranks(0, 96), std::invalid_argument);
+
+	std::vector<uint64_t> data;
+	for (uint64_t i = 0; i < 50000; i++)
+	{
+		data.push_back(i * 7919);
+	}
+	boophf_t bphf(data.size(), data, 1, 2.0, false, false);
+	REQUIRE(bphf.rankSampling() == 128);
+	std::vector<uint64_t> before;
+	for (const auto key : data)
+	{
+		before.push_back(bphf.lookup(key));
+	}
+	for (uint32_t block_bits : {64u, 1024u})
+	{
+		bphf.setRankSampling(block_bits);
+		for (size_t i = 0; i < data.size(); ++i)
+		{
+			REQUIRE(bphf.lookup(data[i]) == before[i]);
+		}
+	}
+}
+
+TEST_CASE("Vectorized bit kernels agree with the generic ones", "[rank][kernels]")
+{
+	std::mt19937_64 rng(21);
+	std::vector<uint64_t> words(2 * 1024 + 13);
+	for (auto& w : words)
+	{
+		w = rng() & rng(); // about a quarter of the bits set
+	}
+	const unsigned long long all_words = words.size();
+	const auto& generic = boomphf::detail::generic_bit_kernels();
+	const auto kernels = boomphf::detail::available_bit_kernels();
+	REQUIRE(kernels.front() == &generic);
+
+	for (const auto* k : kernels)
+	{
+		INFO(k->name);
+		for (uint64_t words_per_block : {1ULL, 2ULL, 4ULL, 8ULL, 64ULL})
+		{
+			for (uint64_t nwords : {1ULL, 7ULL, 1024ULL, all_words})
+			{
+				const uint64_t nblocks = (nwords + words_per_block - 1) / words_per_block;
+				std::vector<uint16_t> expected(nblocks), got(nblocks);
+				REQUIRE(k->block_ranks(words.data(), nwords, words_per_block, got.data()) ==
+				        generic.block_ranks(words.data(), nwords, words_per_block, expected.data()));
+				REQUIRE(got == expected);
+			}
+		}
+	}
+}
+
+TEST_CASE("Slot states build the rank directory with the bit array", "[rank][collisions]")
+{
+	std::mt19937_64 rng(33);
+	// The largest size is converted in parallel rounds
+	for (uint64_t size : {uint64_t(1000), 200 * boomphf::bitVector::SUPERBLOCK_BITS + 4321})
+	{
+		for (uint32_t nthreads : {1u, 4u})
+		{
+			boomphf::slot_states slots(size);
+			for (uint64_t i = 0; i < size / 2; ++i)
+			{
+				slots.insert(rng() % size);
+			}
+
+			uint64_t offset = 7;
+			const boomphf::bitVector ranked = std::move(slots).to_bitvector(offset, 256, nthreads);
+			REQUIRE(ranked.rankBlockBits() == 256);
+
+			boomphf::bitVector expected = ranked;
+			REQUIRE(expected.build_ranks(7, 256) == offset);
+			for (uint64_t i = 0; i < size; i += 1 + rng() % 97)
+			{
+				REQUIRE(ranked.rank(i) == expected.rank(i));
+			}
+		}
+	}
+
+	boomphf::slot_states slots(100);
+	uint64_t offset = 0;
+	REQUIRE_THROWS_AS(std::move(slots).to_bitvector(offset, 96), std::invalid_argument);
+}
+
+TEST_CASE("Slot states count keys per slot and become the level bit array", "[collisions]")
+{
+	std::mt19937_64 rng(41);
+	// The largest size is converted in parallel rounds
+	for (uint64_t size : {uint64_t(1), uint64_t(64), uint64_t(4999), uint64_t(12000000)})
+	{
+		boomphf::slot_states slots(size);
+		std::vector<uint32_t> expected(size);
+		for (uint64_t i = 0; i < size / 2 + 1; ++i)
+		{
+			const uint64_t pos = rng() % size;
+			slots.insert(pos);
+			expected[pos] = std::min(expected[pos] + 1, 2u);
+		}
+		REQUIRE(slots.bitSize() < size * 8 / 5 + 256);
+		uint64_t wrong_states = 0;
+		for (uint64_t i = 0; i < size; ++i)
+		{
+			wrong_states += slots.state(i) != expected[i];
+		}
+		REQUIRE(wrong_states == 0);
+
+		const boomphf::bitVector bits = std::move(slots).to_bitvector(4);
+		REQUIRE(bits.size() == size);
+		uint64_t wrong_bits = 0;
+		for (uint64_t i = 0; i < size; ++i)
+		{
+			wrong_bits += bits.get(i) != (expected[i] == 1);
+		}
+		REQUIRE(wrong_bits == 0);
+	}
+}
+
+TEST_CASE("Partitioned level insertion builds the same MPHF", "[collisions][partitioned]")
+{
+	std::mt19937_64 rng(47);
+	std::vector<uint64_t> data(2200000); // level 0 above the partitioning threshold at gamma 2
+	for (auto& key : data)
+	{
+		key = rng();
+	}
+
+	boophf_t direct(data.size(), data, 4, 2.0, false, false);
+	boomphf::mphf_options options;
+	options.partitioned_insert = true;
+	boophf_t partitioned(data.size(), data, 4, 2.0, false, false, 0.03f, options);
+	uint64_t different = 0;
+	for (const auto key : data)
+	{
+		different += direct.lookup(key) != partitioned.lookup(key);
+	}
+	REQUIRE(different == 0);
+	REQUIRE(partitioned.totalBitSize() == direct.totalBitSize());
+}
+
+TEST_CASE("Blocked level layout", "[blocked]")
+{
+	std::mt19937_64 rng(49);
+	std::vector<uint64_t> data(300000);
+	for (auto& key : data)
+	{
+		key = rng();
+	}
+
+	for (bool minimal : {true, false})
+	{
+		boomphf::mphf_options options;
+		options.minimal = minimal;
+		options.blocked_levels = true;
+		for (double gamma : {1.0, 2.0, 5.0})
+		{
+			boophf_t bphf(data.size(), data, 2, gamma, false, false, 0.03f, options);
+			REQUIRE(bphf.hasBlockedLevels());
+			REQUIRE(bphf.nbFallbackKeys() < 100);
+
+			std::vector<uint64_t> indices;
+			for (const auto key : data)
+			{
+				indices.push_back(bphf.lookup(key));
+			}
+			std::vector<uint64_t> sorted = indices;
+			std::sort(sorted.begin(), sorted.end());
+			REQUIRE(std::unique(sorted.begin(), sorted.end()) == sorted.end());
+			REQUIRE(sorted.back() < bphf.hashRange());
+
+			// The shared lines are never compressed, the deeper levels still can be
+			[[maybe_unused]] const uint32_t ncompressed = bphf.compressLevels(0);
+			for (size_t i = 0; i < data.size(); ++i)
+			{
+				REQUIRE(bphf.lookup(data[i]) == indices[i]);
+			}
+		}
+	}
+}
+
+TEST_CASE("Multiply-shift range reduction", "[reduction]")
+{
+	std::mt19937_64 rng(50);
+	std::vector<uint64_t> data(200000);
+	for (auto& key : data)
+	{
+		key = rng();
+	}
+
+	for (bool blocked : {false, true})
+	{
+		boomphf::mphf_options options;
+		options.blocked_levels = blocked;
+		options.reduction = boomphf::range_reduction::multiply_shift;
+		for (double gamma : {1.0, 2.0, 5.0})
+		{
+			boophf_t bphf(data.size(), data, 2, gamma, false, false, 0.03f, options);
+			REQUIRE(bphf.rangeReduction() == boomphf::range_reduction::multiply_shift);
+			REQUIRE(bphf.hasBlockedLevels() == blocked);
+
+			std::vector<uint64_t> indices;
+			for (const auto key : data)
+			{
+				indices.push_back(bphf.lookup(key));
+			}
+			std::sort(indices.begin(), indices.end());
+			REQUIRE(std::unique(indices.begin(), indices.end()) == indices.end());
+			REQUIRE(indices.back() < data.size());
+		}
+	}
+
+	REQUIRE(boomphf::multiply_shift64(0, 1000) == 0);
+	REQUIRE(boomphf::multiply_shift64(~0ULL, 1000) == 999);
+	REQUIRE(boomphf::multiply_shift64(1ULL << 63, 1000) == 500);
+}
@@ -1,7 +1,9 @@
 #include "BooPHF.h"
 #include "catch2/catch.hpp"
 #include <cstdio>
+#include <array>
 #include <fstream>
+#include <sstream>
 #include <vector>
 
 typedef boomphf::SingleHashFunctor<uint64_t> hasher_t;
@@ -70,3 +72,34 @@ TEST_CASE("Endianness-safe serialization with large dataset", "[endian][large]")
 {
 	test_endian_serialization(10000, 1.0, "large_gamma1");
 }
+
+TEST_CASE("Endianness-safe serialization of 128-bit values", "[endian][wide]")
+{
+	const std::array<uint64_t, 2> arr = {0x0807060504030201ULL, 0x100F0E0D0C0B0A09ULL};
+
+	std::ostringstream os;
+	boomphf::write_le(os, arr);
+	const std::string bytes = os.str();
+	REQUIRE(bytes.size() == 16);
+	for (size_t i = 0; i < bytes.size(); ++i)
+	{
+		REQUIRE(static_cast<uint8_t>(bytes[i]) == i + 1);
+	}
+
+	std::istringstream is(bytes);
+	std::array<uint64_t, 2> arr_read{};
+	boomphf::read_le(is, arr_read);
+	REQUIRE(arr_read == arr);
+
+#if defined(__SIZEOF_INT128__)
+	const __uint128_t value = (static_cast<__uint128_t>(arr[1]) << 64) | arr[0];
+	std::ostringstream os128;
+	boomphf::write_le(os128, value);
+	REQUIRE(os128.str() == bytes);
+
+	std::istringstream is128(bytes);
+	__uint128_t value_read = 0;
+	boomphf::read_le(is128, value_read);
+	REQUIRE(value_read == value);
+#endif
+}
@@ -0,0 +1,119 @@
+#include "BooPHF.h"
+#include "catch2/catch.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+typedef boomphf::mphf<uint64_t, boomphf::WyHasher<uint64_t>> boophf_t;
+
+namespace
+{
+
+size_t file_bytes(const char* filename)
+{
+	std::ifstream is(filename, std::ios::binary | std::ios::ate);
+	return static_cast<size_t>(is.tellg());
+}
+
+// Sorted 64-bit IDs with small random gaps, as produced by most ID allocators
+std::vector<uint64_t> sorted_ids(size_t n)
+{
+	std::mt19937_64 rng(3);
+	std::vector<uint64_t> ids(n);
+	uint64_t id = 1ULL << 40;
+	for (auto& v : ids)
+	{
+		id += 1 + rng() % 1000;
+		v = id;
+	}
+	return ids;
+}
+
+} // namespace
+
+TEST_CASE("Chunked key file round trip", "[keyfile]")
+{
+	const char* filename = "test_keys.bbk";
+	const auto ids = sorted_ids(100000);
+
+	SECTION("Sorted keys are delta-varint compressed")
+	{
+		boomphf::write_key_file(filename, ids, true, 4096);
+		REQUIRE(file_bytes(filename) * 3 < ids.size() * sizeof(uint64_t));
+
+		boomphf::key_file<uint64_t> keys(filename);
+		REQUIRE(keys.size() == ids.size());
+		REQUIRE(keys.nbChunks() == (ids.size() + 4095) / 4096);
+		REQUIRE(std::equal(keys.begin(), keys.end(), ids.begin(), ids.end()));
+	}
+
+	SECTION("Unsorted chunks and uncompressed files are stored raw")
+	{
+		auto shuffled = ids;
+		std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937_64(5));
+		for (bool compress : {true, false})
+		{
+			boomphf::write_key_file(filename, shuffled, compress, 1000);
+			REQUIRE(file_bytes(filename) > shuffled.size() * sizeof(uint64_t));
+
+			boomphf::key_file<uint64_t> keys(filename);
+			REQUIRE(std::equal(keys.begin(), keys.end(), shuffled.begin(), shuffled.end()));
+		}
+	}
+
+	SECTION("Empty file")
+	{
+		boomphf::write_key_file(filename, std::vector<uint64_t>());
+		boomphf::key_file<uint64_t> keys(filename);
+		REQUIRE(keys.size() == 0);
+		REQUIRE(keys.begin() == keys.end());
+	}
+
+	SECTION("Mismatched key size and foreign files are rejected")
+	{
+		boomphf::write_key_file<uint32_t>(filename, std::vector<uint32_t>{1, 2, 3});
+		REQUIRE(boomphf::key_file<uint32_t>(filename).size() == 3);
+		REQUIRE_THROWS_AS(boomphf::key_file<uint64_t>(filename), std::invalid_argument);
+
+		std::ofstream(filename, std::ios::binary) << "not a key file at all, not a key file at all";
+		REQUIRE_THROWS_AS(boomphf::key_file<uint64_t>(filename), std::invalid_argument);
+	}
+
+	std::remove(filename);
+}
+
+TEST_CASE("MPHF built from a chunked key file", "[keyfile]")
+{
+	const char* filename = "test_keys_build.bbk";
+	const auto ids = sorted_ids(60000);
+	boomphf::write_key_file(filename, ids, true, 1 << 12);
+	boomphf::key_file<uint64_t> keys(filename);
+
+	// Chunks are decoded in file order by a single thread, so the result matches an in-memory build
+	boophf_t from_memory(ids.size(), ids, 1, 2.0, true, false);
+	boophf_t from_file(keys.size(), keys, 1, 2.0, true, false);
+	std::ostringstream os_memory, os_file;
+	from_memory.save(os_memory);
+	from_file.save(os_file);
+	REQUIRE(os_memory.str() == os_file.str());
+
+	for (int nthreads : {2, 4})
+	{
+		for (bool writeEach : {false, true})
+		{
+			boophf_t bphf(keys.size(), keys, nthreads, 2.0, writeEach, false);
+			std::vector<bool> seen(ids.size(), false);
+			for (const auto id : ids)
+			{
+				const uint64_t idx = bphf.lookup(id);
+				REQUIRE(idx < ids.size());
+				REQUIRE_FALSE(seen[idx]);
+				seen[idx] = true;
+			}
+		}
+	}
+	std::remove(filename);
+}
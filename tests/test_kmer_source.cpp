@@ -0,0 +1,166 @@
+#include "BooPHF.h"
+#include "catch2/catch.hpp"
+#include "kmer_source.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+std::string random_sequence(size_t len, uint64_t seed)
+{
+	static const char bases[] = "ACGT";
+	std::mt19937_64 rng(seed);
+	std::string seq(len, 'A');
+	for (auto& c : seq)
+	{
+		c = bases[rng() & 3];
+	}
+	return seq;
+}
+
+// Straightforward canonical k-mer enumeration, one k-mer at a time
+template <typename kmer_t> std::vector<kmer_t> naive_kmers(const std::vector<std::string>& records, unsigned k)
+{
+	std::vector<kmer_t> out;
+	for (const auto& rec : records)
+	{
+		for (size_t pos = 0; pos + k <= rec.size(); ++pos)
+		{
+			kmer_t fwd = 0, rev = 0;
+			bool valid = true;
+			for (size_t ii = 0; ii < k; ++ii)
+			{
+				const uint8_t c = boomphf::nucleotide_code(rec[pos + ii]);
+				const uint8_t rc = boomphf::nucleotide_code(rec[pos + k - 1 - ii]);
+				if (c > 3)
+				{
+					valid = false;
+					break;
+				}
+				fwd = (fwd << 2) | c;
+				rev = (rev << 2) | (3 - rc);
+			}
+			if (valid)
+			{
+				out.push_back(std::min(fwd, rev));
+			}
+		}
+	}
+	return out;
+}
+
+void write_fasta(const char* filename, const std::vector<std::string>& records, size_t line_width)
+{
+	std::ofstream os(filename);
+	for (size_t r = 0; r < records.size(); ++r)
+	{
+		os << ">seq" << r << " description\n";
+		for (size_t pos = 0; pos < records[r].size(); pos += line_width)
+		{
+			os << records[r].substr(pos, line_width) << '\n';
+		}
+	}
+}
+
+void write_fastq(const char* filename, const std::vector<std::string>& records)
+{
+	std::ofstream os(filename);
+	for (size_t r = 0; r < records.size(); ++r)
+	{
+		os << "@read" << r << "\n" << records[r] << "\n+\n" << std::string(records[r].size(), 'I') << "\n";
+	}
+}
+
+template <typename kmer_t> std::vector<kmer_t> collect(const boomphf::kmer_file<kmer_t>& kmers)
+{
+	std::vector<kmer_t> out;
+	for (auto it = kmers.begin(); it != kmers.end(); ++it)
+	{
+		out.push_back(*it);
+	}
+	return out;
+}
+
+} // namespace
+
+TEST_CASE("K-mers of FASTA and FASTQ files", "[kmer]")
+{
+	std::vector<std::string> records = {random_sequence(5000, 1), random_sequence(37, 2),
+	                                    "ACGTNNACGTACGTACGTACGTACGTACGTACGTACGTAC", random_sequence(20, 3),
+	                                    random_sequence(3000, 4)};
+	records[4][1234] = 'N';
+	records[0][100] = 'n';
+
+	SECTION("FASTA with records split across chunks")
+	{
+		const char* filename = "test_kmer_source.fa";
+		write_fasta(filename, records, 60);
+		const unsigned k = 31;
+		const auto expected = naive_kmers<uint64_t>(records, k);
+
+		for (size_t chunk_bases : {size_t(31), size_t(100), size_t(1) << 20})
+		{
+			for (unsigned num_thread : {1u, 3u})
+			{
+				boomphf::kmer_file<uint64_t> kmers(filename, k, num_thread, chunk_bases);
+				REQUIRE(collect(kmers) == expected);
+				REQUIRE(kmers.size() == expected.size());
+			}
+		}
+		std::remove(filename);
+	}
+
+	SECTION("FASTQ")
+	{
+		const char* filename = "test_kmer_source.fq";
+		write_fastq(filename, records);
+		const unsigned k = 21;
+		boomphf::kmer_file<uint64_t> kmers(filename, k, 2, 64);
+		const auto expected = naive_kmers<uint64_t>(records, k);
+		REQUIRE(collect(kmers) == expected);
+		REQUIRE(kmers.size() == expected.size());
+		std::remove(filename);
+	}
+
+#if defined(__SIZEOF_INT128__)
+	SECTION("128-bit k-mers")
+	{
+		const char* filename = "test_kmer_source_128.fa";
+		write_fasta(filename, records, 80);
+		const unsigned k = 63;
+		boomphf::kmer_file<__uint128_t> kmers(filename, k, 2, 500);
+		REQUIRE(collect(kmers) == naive_kmers<__uint128_t>(records, k));
+		std::remove(filename);
+	}
+#endif
+
+	REQUIRE_THROWS_AS(boomphf::kmer_file<uint64_t>("unused.fa", 33), std::invalid_argument);
+	REQUIRE_THROWS_AS(boomphf::kmer_file<uint64_t>("unused.fa", 0), std::invalid_argument);
+}
+
+TEST_CASE("MPHF built directly from a FASTA file", "[kmer]")
+{
+	const char* filename = "test_kmer_source_mphf.fa";
+	write_fasta(filename, {random_sequence(100000, 5)}, 70);
+
+	boomphf::kmer_file<uint64_t> kmers(filename, 31, 2, 4096);
+	const uint64_t n = kmers.size();
+	REQUIRE(n == 100000 - 30);
+
+	boomphf::mphf<uint64_t, boomphf::WyHasher<uint64_t>> bphf(n, kmers, 1, 2.0, true, false);
+
+	std::vector<bool> seen(n, false);
+	for (auto it = kmers.begin(); it != kmers.end(); ++it)
+	{
+		const uint64_t idx = bphf.lookup(*it);
+		REQUIRE(idx < n);
+		REQUIRE_FALSE(seen[idx]);
+		seen[idx] = true;
+	}
+	std::remove(filename);
+}
@@ -20,7 +20,7 @@ static std::filesystem::path find_build_dir()
 		auto candidate = p / "build";
 		if (std::filesystem::exists(candidate) && std::filesystem::is_directory(candidate))
 			return candidate;
-		if (!p.has_parent_path())
+		if (!p.has_parent_path() || p.parent_path() == p)
 			break;
 		p = p.parent_path();
 	}
@@ -0,0 +1,78 @@
+#include "catch2/catch.hpp"
+#include "monotone_mphf.hpp"
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+TEST_CASE("Monotone MPHF returns ranks of integer keys", "[monotone]")
+{
+	std::mt19937_64 rng(5);
+	std::vector<uint64_t> keys(40000);
+	for (auto& k : keys)
+	{
+		k = rng() >> (rng() % 40); // mix of long and short common prefixes
+	}
+	std::sort(keys.begin(), keys.end());
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+	for (uint32_t bucket_size : {1u, 7u, 256u})
+	{
+		boomphf::monotone_mphf<uint64_t, boomphf::WyHasher<uint64_t>> mmphf(keys, bucket_size, 2);
+		REQUIRE(mmphf.nbKeys() == keys.size());
+		for (uint64_t i = 0; i < keys.size(); ++i)
+		{
+			REQUIRE(mmphf.lookup(keys[i]) == i);
+		}
+	}
+
+	// Consecutive integers share long prefixes within a bucket
+	std::vector<uint32_t> dense(10000);
+	for (uint32_t i = 0; i < dense.size(); ++i)
+	{
+		dense[i] = 1000 + 3 * i;
+	}
+	boomphf::monotone_mphf<uint32_t> dense_mmphf(dense, 64);
+	for (uint64_t i = 0; i < dense.size(); ++i)
+	{
+		REQUIRE(dense_mmphf.lookup(dense[i]) == i);
+	}
+
+	std::vector<uint64_t> unsorted = {3, 2, 5};
+	REQUIRE_THROWS_AS(boomphf::monotone_mphf<uint64_t>(unsorted), std::invalid_argument);
+}
+
+TEST_CASE("Monotone MPHF over strings", "[monotone][strings]")
+{
+	std::vector<std::string> words;
+	for (int i = 0; i < 6000; ++i)
+	{
+		words.push_back("w" + std::to_string(i));
+		if (i % 10 == 0)
+		{
+			words.push_back("w" + std::to_string(i) + std::string(1, '\0')); // embedded zero byte
+			words.push_back("w" + std::to_string(i) + "\xff");                // high byte
+		}
+	}
+	words.push_back("");
+	std::sort(words.begin(), words.end());
+	words.erase(std::unique(words.begin(), words.end()), words.end());
+
+	using mmphf_t = boomphf::monotone_mphf<std::string, boomphf::StringHasher>;
+	mmphf_t mmphf(words, 16);
+	for (uint64_t i = 0; i < words.size(); ++i)
+	{
+		REQUIRE(mmphf.lookup(words[i]) == i);
+	}
+
+	std::stringstream ss;
+	mmphf.save(ss);
+	mmphf_t loaded;
+	loaded.load(ss);
+	REQUIRE(loaded.bucketSize() == 16);
+	for (uint64_t i = 0; i < words.size(); ++i)
+	{
+		REQUIRE(loaded.lookup(words[i]) == i);
+	}
+}
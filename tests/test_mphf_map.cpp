@@ -0,0 +1,190 @@
+#include "catch2/catch.hpp"
+#include "mphf_map.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+typedef boomphf::mphf_map<uint64_t, uint16_t, boomphf::WyHasher<uint64_t>> category_map_t;
+
+namespace
+{
+
+struct map_data
+{
+	std::vector<uint64_t> keys;
+	std::vector<uint16_t> values;
+	std::vector<uint64_t> absent;
+};
+
+map_data make_data(size_t n)
+{
+	map_data d;
+	std::mt19937_64 rng(17);
+	for (size_t i = 0; i < n; ++i)
+	{
+		d.keys.push_back(rng() | 1); // absent keys are even
+		d.values.push_back(static_cast<uint16_t>(rng() % 4096));
+		d.absent.push_back(rng() & ~1ULL);
+	}
+	return d;
+}
+
+void check_map(const category_map_t& map, const map_data& d)
+{
+	REQUIRE(map.size() == d.keys.size());
+	for (size_t i = 0; i < d.keys.size(); ++i)
+	{
+		REQUIRE(map.get(d.keys[i]) == d.values[i]);
+		REQUIRE(map.find(d.keys[i]) == d.values[i]);
+	}
+
+	std::vector<uint16_t> out(d.keys.size());
+	REQUIRE(map.get(d.keys.data(), d.keys.size(), out.data()) == d.keys.size());
+	REQUIRE(out == d.values);
+
+	if (map.verifiesKeys())
+	{
+		for (const auto k : d.absent)
+		{
+			REQUIRE_FALSE(map.find(k).has_value());
+		}
+		REQUIRE(map.get(d.absent.data(), d.absent.size(), out.data(), uint16_t(0xFFFF)) == 0);
+		REQUIRE(std::all_of(out.begin(), out.end(), [](uint16_t v) { return v == 0xFFFF; }));
+	}
+}
+
+} // namespace
+
+TEST_CASE("mphf_map with bit-packed values", "[map]")
+{
+	const auto d = make_data(20000);
+
+	for (bool verify : {false, true})
+	{
+		category_map_t map(d.keys, d.values, 0, verify, 2);
+		REQUIRE(map.bitsPerValue() == 12);
+		REQUIRE(map.payloadBitSize() < 13 * d.keys.size() + (verify ? 64 * d.keys.size() + 256 : 256));
+		check_map(map, d);
+
+		SECTION("stream round trip")
+		{
+			std::stringstream ss;
+			map.save(ss);
+			category_map_t loaded;
+			loaded.load(ss);
+			REQUIRE(loaded.verifiesKeys() == verify);
+			check_map(loaded, d);
+		}
+
+		SECTION("memory-mapped file")
+		{
+			const char* filename = "test_mphf_map.bin";
+			{
+				std::ofstream os(filename, std::ios::binary);
+				map.save(os);
+			}
+			{
+				category_map_t mapped;
+				mapped.load_mapped(filename);
+				check_map(mapped, d);
+			}
+			std::remove(filename);
+		}
+	}
+
+	REQUIRE_THROWS_AS(category_map_t(d.keys, d.values, 8), std::invalid_argument);
+	REQUIRE_THROWS_AS(category_map_t(d.keys, std::vector<uint16_t>(3)), std::invalid_argument);
+
+	auto duplicated = d.keys;
+	duplicated.back() = duplicated.front();
+	for (bool verify : {false, true})
+	{
+		REQUIRE_THROWS_AS(category_map_t(duplicated, d.values, 0, verify, 2), std::invalid_argument);
+	}
+}
+
+TEST_CASE("Corrupted mphf_map files are rejected", "[map]")
+{
+	const auto d = make_data(2000);
+	std::stringstream ss;
+	category_map_t(d.keys, d.values, 0, true).save(ss);
+	const std::string bytes = ss.str();
+
+	const auto fails = [](const std::string& corrupted)
+	{
+		std::istringstream is(corrupted);
+		category_map_t loaded;
+		REQUIRE_THROWS_AS(loaded.load(is), std::runtime_error);
+
+		const char* filename = "test_mphf_map_corrupted.bin";
+		{
+			std::ofstream os(filename, std::ios::binary);
+			os << corrupted;
+		}
+		category_map_t mapped;
+		REQUIRE_THROWS_AS(mapped.load_mapped(filename), std::runtime_error);
+		std::remove(filename);
+	};
+
+	// Key count in the header, after the magic, version and flags
+	std::string corrupted = bytes;
+	corrupted[16] ^= 1;
+	fails(corrupted);
+
+	// The stored keys close the file: count and size, then one word per key. One key fewer than values.
+	corrupted = bytes.substr(0, bytes.size() - 8);
+	const size_t keys_section = corrupted.size() - 16 - 8 * (d.keys.size() - 1);
+	std::stringstream section;
+	boomphf::write_le(section, static_cast<uint64_t>(d.keys.size() - 1));
+	boomphf::write_le(section, static_cast<uint64_t>(8 * (d.keys.size() - 1)));
+	corrupted.replace(keys_section, 16, section.str());
+	fails(corrupted);
+
+	std::istringstream truncated(bytes.substr(0, bytes.size() - 5));
+	category_map_t loaded;
+	REQUIRE_THROWS_AS(loaded.load(truncated), std::runtime_error);
+}
+
+TEST_CASE("mphf_map with string keys and enum values", "[map][strings]")
+{
+	enum class color : uint8_t
+	{
+		red,
+		green,
+		blue
+	};
+	std::vector<std::string> keys;
+	std::vector<color> values;
+	for (int i = 0; i < 5000; ++i)
+	{
+		keys.push_back("user-" + std::to_string(i));
+		values.push_back(static_cast<color>(i % 3));
+	}
+
+	boomphf::mphf_map<std::string, color, boomphf::StringHasher> map(keys, values, 2, true);
+	for (size_t i = 0; i < keys.size(); ++i)
+	{
+		REQUIRE(map.find(keys[i]) == values[i]);
+	}
+	REQUIRE_FALSE(map.find("user-5000").has_value());
+
+	const char* filename = "test_mphf_map_strings.bin";
+	{
+		std::ofstream os(filename, std::ios::binary);
+		map.save(os);
+	}
+	{
+		boomphf::mphf_map<std::string, color, boomphf::StringHasher> mapped;
+		mapped.load_mapped(filename);
+		for (size_t i = 0; i < keys.size(); ++i)
+		{
+			REQUIRE(mapped.get(keys[i]) == values[i]);
+		}
+		REQUIRE_FALSE(mapped.find("nobody").has_value());
+	}
+	std::remove(filename);
+}
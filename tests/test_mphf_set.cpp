@@ -0,0 +1,145 @@
+#include "catch2/catch.hpp"
+#include "mphf_map.hpp"
+#include "mphf_set.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+TEST_CASE("mphf_set with integer keys", "[set]")
+{
+	std::mt19937_64 rng(23);
+	std::vector<uint64_t> keys(30000);
+	for (auto& k : keys)
+	{
+		k = rng() | 1; // queries below are even
+	}
+	std::sort(keys.begin(), keys.end());
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+	using set_t = boomphf::mphf_set<uint64_t, boomphf::WyHasher<uint64_t>>;
+	const auto check_set = [&](const set_t& set)
+	{
+		REQUIRE(set.size() == keys.size());
+		std::vector<bool> seen(keys.size());
+		for (const auto k : keys)
+		{
+			const uint64_t id = set.id(k);
+			REQUIRE(id < keys.size());
+			REQUIRE_FALSE(seen[id]);
+			seen[id] = true;
+			REQUIRE(set.key_at(id) == k);
+			REQUIRE(set.contains(k));
+		}
+		for (int i = 0; i < 10000; ++i)
+		{
+			REQUIRE_FALSE(set.contains(rng() & ~1ULL));
+		}
+		REQUIRE_THROWS_AS(set.key_at(keys.size()), std::out_of_range);
+	};
+
+	set_t set(keys, 2);
+	check_set(set);
+	REQUIRE(set.payloadBitSize() == 64 * keys.size());
+
+	SECTION("stream round trip")
+	{
+		std::stringstream ss;
+		set.save(ss);
+		set_t loaded;
+		loaded.load(ss);
+		check_set(loaded);
+	}
+
+	SECTION("memory-mapped file")
+	{
+		const char* filename = "test_mphf_set.bin";
+		{
+			std::ofstream os(filename, std::ios::binary);
+			set.save(os);
+		}
+		{
+			set_t mapped;
+			mapped.load_mapped(filename);
+			check_set(mapped);
+
+			// Not an mphf_set file
+			std::stringstream ss;
+			boomphf::mphf_map<uint64_t, uint8_t, boomphf::WyHasher<uint64_t>>(keys, std::vector<uint8_t>(keys.size()))
+			    .save(ss);
+			set_t other;
+			REQUIRE_THROWS_AS(other.load(ss), std::runtime_error);
+		}
+		std::remove(filename);
+	}
+
+	// A duplicate can land on an id below n already taken by its first copy
+	std::vector<uint64_t> duplicated;
+	for (uint64_t k = 7; k <= 7000; k += 7)
+	{
+		duplicated.push_back(k);
+	}
+	duplicated.push_back(7);
+	REQUIRE_THROWS_AS(set_t(duplicated, 2), std::invalid_argument);
+	REQUIRE_THROWS_AS(set_t(duplicated), std::invalid_argument);
+}
+
+TEST_CASE("mphf_set as a string dictionary", "[set][strings]")
+{
+	std::vector<std::string> words;
+	for (int i = 0; i < 8000; ++i)
+	{
+		words.push_back("word_" + std::to_string(i * 31));
+	}
+	boomphf::mphf_set<std::string, boomphf::StringHasher> dict(words, 2);
+
+	// Encode then decode
+	std::vector<uint64_t> encoded;
+	for (const auto& w : words)
+	{
+		encoded.push_back(dict.id(w));
+	}
+	for (size_t i = 0; i < words.size(); ++i)
+	{
+		REQUIRE(dict.key_at(encoded[i]) == words[i]);
+	}
+	REQUIRE(dict.id("word_1") == ULLONG_MAX);
+	REQUIRE_FALSE(dict.contains(""));
+
+	const char* filename = "test_mphf_set_strings.bin";
+	{
+		std::ofstream os(filename, std::ios::binary);
+		dict.save(os);
+	}
+	{
+		boomphf::mphf_set<std::string, boomphf::StringHasher> mapped;
+		mapped.load_mapped(filename);
+		for (size_t i = 0; i < words.size(); ++i)
+		{
+			REQUIRE(mapped.id(words[i]) == encoded[i]);
+			REQUIRE(mapped.key_at(encoded[i]) == words[i]);
+		}
+	}
+	std::remove(filename);
+
+	// Keys section size smaller than its offsets: rejected before anything is allocated from it
+	std::stringstream ss;
+	dict.save(ss);
+	std::string bytes = ss.str();
+	uint64_t mphf_bytes = 0;
+	for (size_t b = 0; b < 8; ++b)
+	{
+		mphf_bytes |= static_cast<uint64_t>(static_cast<uint8_t>(bytes[24 + b])) << (8 * b);
+	}
+	const size_t keys_section = 32 + (mphf_bytes + 7) / 8 * 8;
+	std::stringstream section;
+	boomphf::write_le(section, static_cast<uint64_t>(words.size()));
+	boomphf::write_le(section, uint64_t(8));
+	bytes.replace(keys_section, 16, section.str());
+	std::istringstream is(bytes);
+	boomphf::mphf_set<std::string, boomphf::StringHasher> loaded;
+	REQUIRE_THROWS_AS(loaded.load(is), std::runtime_error);
+}
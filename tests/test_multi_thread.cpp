@@ -1,4 +1,6 @@
 ﻿#include "BooPHF.h"
+#include "permute.hpp"
+#include "relabel.hpp"
 #include "catch2/catch.hpp"
 #include <algorithm>
 #include <cstdio>
@@ -9,6 +11,7 @@
 #include <random>
 #include <set>
 #include <sstream>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -111,4 +114,140 @@ TEST_CASE("Multi-thread builds equal across thread counts (binary + lookup)", "[
 		fname << "test_threads_" << kv.first << ".mphf";
 		std::remove(fname.str().c_str());
 	}
-}
\ No newline at end of file
+}
+
+TEST_CASE("Multi-thread builds from a memory-mapped key file", "[multithread][file]")
+{
+	const size_t N = 50000;
+	std::vector<uint64_t> data(N);
+	std::mt19937_64 rng(7);
+	for (auto& k : data)
+	{
+		k = rng();
+	}
+
+	const char* filename = "test_keys_mapped.bin";
+	{
+		std::ofstream os(filename, std::ios::binary);
+		os.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(N * sizeof(uint64_t)));
+	}
+
+	{
+		boomphf::file_binary<uint64_t> keys(filename);
+		REQUIRE(keys.size() == N);
+		REQUIRE(keys[123] == data[123]);
+		REQUIRE(std::equal(keys.begin(), keys.end(), data.begin(), data.end()));
+
+		// Same single-thread result as building from memory
+		boophf_t from_memory(N, data, 1, 1.0, true, false);
+		boophf_t from_file(N, keys, 1, 1.0, true, false);
+		std::ostringstream os_memory, os_file;
+		from_memory.save(os_memory);
+		from_file.save(os_file);
+		REQUIRE(os_memory.str() == os_file.str());
+
+		// Threads take chunks of the mapping directly, whatever the core count
+		for (int nthreads : {2, 4})
+		{
+			for (bool writeEach : {false, true})
+			{
+				boophf_t bphf(N, keys, nthreads, 2.0, writeEach, false);
+				std::vector<bool> seen(N, false);
+				for (const auto k : data)
+				{
+					const uint64_t idx = bphf.lookup(k);
+					REQUIRE(idx < N);
+					REQUIRE_FALSE(seen[idx]);
+					seen[idx] = true;
+				}
+			}
+		}
+	}
+
+	// Truncated files are rejected instead of silently dropping the last key
+	{
+		std::ofstream os(filename, std::ios::binary | std::ios::app);
+		os.put('x');
+	}
+	REQUIRE_THROWS_AS(boomphf::file_binary<uint64_t>(filename), std::invalid_argument);
+	std::remove(filename);
+}
+
+TEST_CASE("Relabel a key file into dense ids", "[multithread][relabel]")
+{
+	const size_t N = 30000;
+	std::vector<uint64_t> data(N);
+	std::mt19937_64 rng(11);
+	for (auto& k : data)
+	{
+		k = rng();
+	}
+	boophf_t bphf(N, data, 1, 2.0, false, false);
+
+	// Edge-list style input: every key appears several times
+	std::vector<uint64_t> edges;
+	for (size_t i = 0; i < 3 * N; ++i)
+	{
+		edges.push_back(data[rng() % N]);
+	}
+
+	const char* keys_name = "test_relabel_keys.bin";
+	const char* ids_name = "test_relabel_ids.bin";
+	{
+		std::ofstream os(keys_name, std::ios::binary);
+		os.write(reinterpret_cast<const char*>(edges.data()),
+		         static_cast<std::streamsize>(edges.size() * sizeof(uint64_t)));
+	}
+
+	for (unsigned nthreads : {1u, 3u})
+	{
+		// Small batches so that writes overlap with the following lookups
+		REQUIRE(boomphf::relabel(bphf, keys_name, ids_name, nthreads, 7000) == edges.size());
+
+		boomphf::file_binary<uint64_t> ids(ids_name);
+		REQUIRE(ids.size() == edges.size());
+		for (size_t i = 0; i < edges.size(); ++i)
+		{
+			REQUIRE(ids[i] == bphf.lookup(edges[i]));
+		}
+	}
+
+	std::remove(keys_name);
+	std::remove(ids_name);
+}
+
+TEST_CASE("Permute value columns into MPHF order", "[multithread][permute]")
+{
+	const size_t N = 40000;
+	std::vector<uint64_t> keys(N);
+	std::mt19937_64 rng(13);
+	for (auto& k : keys)
+	{
+		k = rng();
+	}
+	boophf_t bphf(N, keys, 1, 2.0, false, false);
+
+	for (unsigned nthreads : {1u, 4u})
+	{
+		std::vector<uint32_t> ranks(N);
+		std::vector<std::string> names(N);
+		std::vector<uint64_t> raw(N);
+		for (size_t i = 0; i < N; ++i)
+		{
+			ranks[i] = static_cast<uint32_t>(i);
+			names[i] = "key" + std::to_string(keys[i]);
+			raw[i] = ~keys[i];
+		}
+
+		// Vectors and plain pointers can be mixed
+		boomphf::permute_to_mphf_order(bphf, keys.data(), N, nthreads, ranks, names, raw.data());
+
+		for (size_t i = 0; i < N; ++i)
+		{
+			const uint64_t idx = bphf.lookup(keys[i]);
+			REQUIRE(ranks[idx] == i);
+			REQUIRE(names[idx] == "key" + std::to_string(keys[i]));
+			REQUIRE(raw[idx] == ~keys[i]);
+		}
+	}
+}
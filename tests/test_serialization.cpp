@@ -1,8 +1,11 @@
 #include "BooPHF.h"
 #include "catch2/catch.hpp"
+#include <array>
 #include <cstdio>
 #include <fstream>
 #include <memory>
+#include <sstream>
+#include <string>
 #include <vector>
 
 typedef boomphf::SingleHashFunctor<uint64_t> hasher_t;
@@ -88,3 +91,359 @@ TEST_CASE("MPHF serialization with different gamma values", "[serialization][gam
 		std::remove(filename);
 	}
 }
+
+TEST_CASE("MPHF serialization keeps the hash seed", "[serialization][seed]")
+{
+	std::vector<uint64_t> data;
+	for (uint64_t i = 0; i < 2000; i++)
+	{
+		data.push_back(i * 5);
+	}
+
+	SECTION("Seeded build reloads with the same seed")
+	{
+		const char* filename = "test_seed.mphf";
+
+		boomphf::mphf_options options;
+		options.seed = 0xC0FFEE;
+		boophf_t bphf(data.size(), data, 1, 2.0, false, false, 0.03f, options);
+		{
+			std::ofstream os(filename, std::ios::binary);
+			bphf.save(os);
+		}
+
+		boophf_t bphf_load;
+		{
+			std::ifstream is(filename, std::ios::binary);
+			bphf_load.load(is);
+		}
+
+		REQUIRE(bphf_load.seed() == 0xC0FFEE);
+		for (const auto& key : data)
+		{
+			REQUIRE(bphf.lookup(key) == bphf_load.lookup(key));
+		}
+
+		std::remove(filename);
+	}
+
+	SECTION("Files without format header still load")
+	{
+		boophf_t bphf(data.size(), data, 1, 2.0, false, false);
+		std::ostringstream os;
+		bphf.save(os);
+
+		// Strip magic, version and seed to get the pre-header layout
+		const std::string bytes = os.str();
+		const size_t header_size = sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint64_t);
+		std::istringstream is(bytes.substr(header_size));
+
+		boophf_t bphf_load;
+		bphf_load.load(is);
+
+		REQUIRE(bphf_load.seed() == 0);
+		for (const auto& key : data)
+		{
+			REQUIRE(bphf.lookup(key) == bphf_load.lookup(key));
+		}
+	}
+}
+
+TEST_CASE("MPHF serialization with string keys", "[serialization][strings]")
+{
+	std::vector<std::string> data;
+	for (uint64_t i = 0; i < 3000; i++)
+	{
+		data.push_back("key_" + std::to_string(i * 17));
+	}
+	// Duplicates always reach the fallback level, so the length-prefixed key encoding gets exercised
+	data.push_back("key_0");
+	data.push_back("key_17");
+
+	boomphf::mphf<std::string, boomphf::StringHasher> bphf(data.size(), data, 1, 2.0, false, false);
+	REQUIRE(bphf.nbFallbackKeys() == 2);
+
+	std::stringstream ss;
+	bphf.save(ss);
+
+	boomphf::mphf<std::string, boomphf::StringHasher> bphf_load;
+	bphf_load.load(ss);
+
+	REQUIRE(bphf_load.nbFallbackKeys() == 2);
+	for (const auto& key : data)
+	{
+		REQUIRE(bphf.lookup(key) == bphf_load.lookup(key));
+	}
+}
+
+TEST_CASE("Corrupted string keys are rejected", "[serialization][strings]")
+{
+	using traits = boomphf::key_traits<std::string>;
+	std::stringstream ss;
+	traits::write(ss, "fallback key");
+	const std::string bytes = ss.str();
+	std::string key;
+
+	std::istringstream whole(bytes);
+	traits::read(whole, key);
+	REQUIRE(key == "fallback key");
+
+	std::istringstream truncated_key(bytes.substr(0, bytes.size() - 1));
+	REQUIRE_THROWS_AS(traits::read(truncated_key, key), std::runtime_error);
+	std::istringstream truncated_length(bytes.substr(0, 5));
+	REQUIRE_THROWS_AS(traits::read(truncated_length, key), std::runtime_error);
+
+	std::stringstream huge;
+	boomphf::write_le(huge, traits::MAX_KEY_BYTES + 1);
+	huge << "short";
+	REQUIRE_THROWS_AS(traits::read(huge, key), std::runtime_error);
+}
+
+TEST_CASE("MPHF serialization keeps fingerprints", "[serialization][fingerprint]")
+{
+	std::vector<uint64_t> data;
+	for (uint64_t i = 0; i < 5000; i++)
+	{
+		data.push_back(i * 7);
+	}
+	boophf_t bphf(data.size(), data, 1, 2.0, false, false);
+	bphf.addFingerprints(data, 12);
+
+	std::stringstream ss;
+	bphf.save(ss);
+	boophf_t bphf_load;
+	bphf_load.load(ss);
+
+	REQUIRE(bphf_load.fingerprintBits() == 12);
+	for (uint64_t i = 0; i < 5000; i++)
+	{
+		REQUIRE(bphf_load.lookup(data[i]) == bphf.lookup(data[i]));
+		REQUIRE(bphf_load.lookup(i * 7 + 3) == bphf.lookup(i * 7 + 3));
+	}
+}
+
+TEST_CASE("MPHF serialization of a non-minimal hash", "[serialization][non-minimal]")
+{
+	std::vector<uint64_t> data;
+	for (uint64_t i = 0; i < 5000; i++)
+	{
+		data.push_back(i * 11);
+	}
+	boomphf::mphf_options options;
+	options.minimal = false;
+	boophf_t bphf(data.size(), data, 1, 2.0, false, false, 0.03f, options);
+
+	std::stringstream ss;
+	bphf.save(ss);
+	boophf_t bphf_load;
+	bphf_load.load(ss);
+
+	REQUIRE_FALSE(bphf_load.isMinimal());
+	REQUIRE(bphf_load.hashRange() == bphf.hashRange());
+	for (const auto key : data)
+	{
+		REQUIRE(bphf_load.lookup(key) == bphf.lookup(key));
+	}
+}
+
+TEST_CASE("MPHF serialization with compressed levels and rank sampling", "[serialization][elias_fano]")
+{
+	std::vector<uint64_t> data;
+	for (uint64_t i = 0; i < 20000; i++)
+	{
+		data.push_back(i * 13);
+	}
+	boophf_t bphf(data.size(), data, 1, 5.0, false, false);
+	REQUIRE(bphf.compressLevels() > 0);
+	bphf.setRankSampling(256);
+
+	std::stringstream ss;
+	bphf.save(ss);
+	boophf_t bphf_load;
+	bphf_load.load(ss);
+	REQUIRE(bphf_load.rankSampling() == 256);
+
+	for (const auto key : data)
+	{
+		REQUIRE(bphf_load.lookup(key) == bphf.lookup(key));
+	}
+}
+
+TEST_CASE("Corrupted Elias-Fano sets are rejected", "[serialization][elias_fano]")
+{
+	boomphf::bitVector bv(100000);
+	for (uint64_t i = 0; i < bv.size(); i += 37)
+	{
+		bv.set(i);
+	}
+	std::stringstream ss;
+	boomphf::elias_fano(bv).save(ss);
+	const std::string bytes = ss.str();
+	auto fails = [](const std::string& corrupted)
+	{
+		std::istringstream is(corrupted);
+		boomphf::elias_fano ef;
+		REQUIRE_THROWS_AS(ef.load(is), std::runtime_error);
+	};
+
+	std::istringstream whole(bytes);
+	boomphf::elias_fano ef;
+	ef.load(whole);
+	REQUIRE(ef.rank(1000) == 28);
+
+	// The zero samples close the file: their count, then one word each
+	auto word_at = [&](size_t pos)
+	{
+		uint64_t w = 0;
+		for (size_t b = 0; b < 8; ++b)
+		{
+			w |= static_cast<uint64_t>(static_cast<uint8_t>(bytes[pos + b])) << (8 * b);
+		}
+		return w;
+	};
+	uint64_t nsamples = 1;
+	while (word_at(bytes.size() - 8 * nsamples - 8) != nsamples)
+	{
+		++nsamples;
+	}
+
+	std::string corrupted = bytes;
+	corrupted[8] ^= 1; // count
+	fails(corrupted);
+	corrupted = bytes;
+	corrupted[24] += 1; // low bits
+	fails(corrupted);
+	corrupted = bytes;
+	corrupted[bytes.size() - 8 * nsamples - 8] += 1;
+	fails(corrupted);
+	corrupted = bytes;
+	corrupted.back() = 0x7f; // last zero sample past the upper bits
+	fails(corrupted);
+	fails(bytes.substr(0, bytes.size() - 3));
+}
+
+TEST_CASE("MPHF serialization of the blocked level layout", "[serialization][blocked]")
+{
+	std::vector<uint64_t> data;
+	for (uint64_t i = 0; i < 20000; i++)
+	{
+		data.push_back(i * 17);
+	}
+	for (bool minimal : {true, false})
+	{
+		boomphf::mphf_options options;
+		options.minimal = minimal;
+		options.blocked_levels = true;
+		boophf_t bphf(data.size(), data, 1, 2.0, false, false, 0.03f, options);
+
+		std::stringstream ss;
+		bphf.save(ss);
+		boophf_t bphf_load;
+		bphf_load.load(ss);
+
+		REQUIRE(bphf_load.hasBlockedLevels());
+		REQUIRE(bphf_load.hashRange() == bphf.hashRange());
+		for (const auto key : data)
+		{
+			REQUIRE(bphf_load.lookup(key) == bphf.lookup(key));
+		}
+	}
+}
+
+TEST_CASE("MPHF serialization keeps the range reduction", "[serialization][reduction]")
+{
+	std::vector<uint64_t> data;
+	for (uint64_t i = 0; i < 20000; i++)
+	{
+		data.push_back(i * 19);
+	}
+	for (auto reduction : {boomphf::range_reduction::modulo, boomphf::range_reduction::multiply_shift})
+	{
+		boomphf::mphf_options options;
+		options.reduction = reduction;
+		boophf_t bphf(data.size(), data, 1, 2.0, false, false, 0.03f, options);
+
+		std::stringstream ss;
+		bphf.save(ss);
+		boophf_t bphf_load;
+		bphf_load.load(ss);
+
+		REQUIRE(bphf_load.rangeReduction() == reduction);
+		for (const auto key : data)
+		{
+			REQUIRE(bphf_load.lookup(key) == bphf.lookup(key));
+		}
+	}
+
+	// Files before version 7 have no reduction flag and always use modulo
+	boomphf::mphf_options options;
+	options.reduction = boomphf::range_reduction::multiply_shift;
+	boophf_t bphf(data.size(), data, 1, 2.0, false, false, 0.03f, options);
+	std::stringstream ss;
+	bphf.save(ss);
+	std::string bytes = ss.str();
+	bytes[8] = 6; // version, after the magic
+	std::stringstream older(bytes);
+	boophf_t bphf_load;
+	bphf_load.load(older);
+	REQUIRE(bphf_load.rangeReduction() == boomphf::range_reduction::modulo);
+}
+
+TEST_CASE("MPHF serialization with 128-bit keys", "[serialization][wide]")
+{
+	using key128_t = std::array<uint64_t, 2>;
+	using phf128_t = boomphf::mphf<key128_t, boomphf::Hasher128<key128_t>>;
+
+	std::vector<key128_t> data;
+	for (uint64_t i = 0; i < 3000; i++)
+	{
+		data.push_back({i * 3, ~i});
+	}
+	// A duplicate forces one key into the fallback table
+	data.push_back(data.front());
+
+	phf128_t bphf(data.size(), data, 1, 2.0, false, false);
+	REQUIRE(bphf.nbFallbackKeys() == 1);
+
+	std::stringstream ss;
+	bphf.save(ss);
+
+	phf128_t bphf_load;
+	bphf_load.load(ss);
+
+	for (const auto& key : data)
+	{
+		REQUIRE(bphf.lookup(key) == bphf_load.lookup(key));
+	}
+}
+
+TEST_CASE("MPHF serialization with digest keys", "[serialization][digest]")
+{
+	using digest32_t = boomphf::digest_t<32>;
+	using digest_phf_t = boomphf::mphf<digest32_t, boomphf::DigestHasher<digest32_t>>;
+
+	std::vector<digest32_t> data(3000);
+	for (size_t i = 0; i < data.size(); i++)
+	{
+		for (size_t b = 0; b < 32; b++)
+		{
+			data[i][b] = static_cast<uint8_t>(boomphf::splitmix64(i * 32 + b));
+		}
+	}
+	// A duplicate forces one digest into the fallback table
+	data.push_back(data.front());
+
+	digest_phf_t bphf(data.size(), data, 1, 2.0, false, false);
+	REQUIRE(bphf.nbFallbackKeys() == 1);
+
+	std::stringstream ss;
+	bphf.save(ss);
+
+	digest_phf_t bphf_load;
+	bphf_load.load(ss);
+
+	for (const auto& key : data)
+	{
+		REQUIRE(bphf.lookup(key) == bphf_load.lookup(key));
+	}
+}